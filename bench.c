@@ -0,0 +1,332 @@
+/*
+ * bench.c
+ *
+ * Benchmarks the hot paths of wincurses: writing characters and formatted
+ * text into a window, refreshing the whole screen or a few cells of it,
+ * scrolling, and draining key presses from the input queue. Each benchmark is
+ * run at a few fixed screen sizes.
+ *
+ * Usage: bench [-vt | -mem] [file]
+ *
+ *   -vt   Use the virtual terminal backend (see 'wc_backend').
+ *   -mem  Use the memory backend, which needs no console and leaves out the
+ *         console's own cost, so only the library's is measured.
+ *   file  Where to write the results (bench_output.txt by default).
+ *
+ * The results are written as comma-separated values, one benchmark and screen
+ * size per line, after a header line:
+ *
+ *   bench,lines,cols,ops,usec,usec_per_op
+ *
+ * Sizes which the console cannot be resized to are skipped (and noted with an
+ * 'ops' of zero).
+ */
+
+#include "wincurses.h"
+
+/* The screen sizes benchmarked, as rows and columns */
+int sizes[][2] = { { 25, 80 }, { 60, 200 }, { 120, 400 } };
+
+/* How many times each benchmark is repeated */
+#define FILLS 20      /* Whole windows filled with 'waddch' */
+#define PRINTS 20     /* Whole windows filled with 'wprintw' */
+#define FULLS 50      /* Refreshes of the whole screen */
+#define SPARSES 1000  /* Refreshes of a few cells */
+#define SPARSECELLS 8 /* Cells changed by each of those */
+#define SCROLLS 500   /* Lines scrolled */
+#define KEYBATCHES 16 /* Batches of key presses drained */
+#define KEYBATCH 256  /* Key presses in each batch */
+
+/* The file results are written to */
+FILE *out;
+
+/* Whether the memory backend is in use, which input is queued for directly */
+int headless;
+
+/* Performance counter ticks in a second */
+LARGE_INTEGER freq;
+
+
+/******************************************************************************
+ *
+ * now
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Reads the performance counter.
+ *
+ * RETURN VALUE:   Returns the current performance counter ticks.
+ *
+ *****************************************************************************/
+
+LONGLONG now(void)
+{
+	LARGE_INTEGER t;
+
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+
+/******************************************************************************
+ *
+ * report
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Writes one line of results: the benchmark called 'name' at
+ *                 'lines' rows by 'cols' columns did 'ops' operations in
+ *                 'ticks' performance counter ticks.
+ *
+ *****************************************************************************/
+
+void report(const char *name, int lines, int cols, long ops, LONGLONG ticks)
+{
+	double usec;
+
+	usec = (double)ticks * 1000000.0 / (double)freq.QuadPart;
+	fprintf(out, "%s,%d,%d,%ld,%.0f,%.4f\n", name, lines, cols, ops, usec,
+			ops ? usec / ops : 0.0);
+}
+
+
+/******************************************************************************
+ *
+ * benchaddch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Fills the window pointed to by 'win' with 'waddch' over and
+ *                 over again, cycling through the printable characters and a
+ *                 few attributes.
+ *
+ *****************************************************************************/
+
+void benchaddch(WINDOW *win, int lines, int cols)
+{
+	LONGLONG start;
+	int i, y, x;
+
+	start = now();
+	for (i = 0; i < FILLS; i++)
+		for (y = 0; y < lines; y++) {
+			wmove(win, y, 0);
+			for (x = 0; x < cols; x++)
+				waddch(win, ('!' + (i + x) % 94) | (x & 8 ? A_BOLD : 0));
+		}
+	report("waddch", lines, cols, (long)FILLS * lines * cols, now() - start);
+}
+
+
+/******************************************************************************
+ *
+ * benchprintw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Fills the window pointed to by 'win' a row at a time with
+ *                 'mvwprintw', using a mix of literal text, strings and
+ *                 numbers like a status display would.
+ *
+ *****************************************************************************/
+
+void benchprintw(WINDOW *win, int lines, int cols)
+{
+	LONGLONG start;
+	int i, y;
+
+	start = now();
+	for (i = 0; i < PRINTS; i++)
+		for (y = 0; y < lines; y++)
+			mvwprintw(win, y, 0, "%5d %-12s %08x %6.2f%% %s", i * lines + y,
+					"channel", y * 2654435761u, (y % 100) * 1.25,
+					"ok ok ok ok ok ok ok ok ok ok ok ok ok ok ok ok");
+	report("printw", lines, cols, (long)PRINTS * lines, now() - start);
+}
+
+
+/******************************************************************************
+ *
+ * benchrefresh
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Times refreshes which change every cell of the screen, and
+ *                 refreshes which change only a few scattered cells.
+ *
+ *****************************************************************************/
+
+void benchrefresh(int lines, int cols)
+{
+	LONGLONG start;
+	int i, y, x;
+
+	/* Start from a screen which is already on the console */
+	erase();
+	refresh();
+
+	start = now();
+	for (i = 0; i < FULLS; i++) {
+		for (y = 0; y < lines; y++) {
+			move(y, 0);
+			for (x = 0; x < cols; x++)
+				addch('a' + (i + y + x) % 26);
+		}
+		refresh();
+	}
+	report("refresh_full", lines, cols, FULLS, now() - start);
+
+	start = now();
+	for (i = 0; i < SPARSES; i++) {
+		for (x = 0; x < SPARSECELLS; x++)
+			mvaddch((i * 7 + x * 13) % lines, (i * 31 + x * 17) % cols,
+					'0' + i % 10);
+		refresh();
+	}
+	report("refresh_sparse", lines, cols, SPARSES, now() - start);
+}
+
+
+/******************************************************************************
+ *
+ * benchscroll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Times a log scrolling up the screen a line at a time, with
+ *                 a refresh after each line.
+ *
+ *****************************************************************************/
+
+void benchscroll(int lines, int cols)
+{
+	LONGLONG start;
+	int i;
+
+	/* Fill the screen with lines first, so that there is something to move */
+	erase();
+	scrollok(stdscr, TRUE);
+	for (i = 0; i < lines; i++)
+		mvprintw(i, 0, "log line %d", i);
+	refresh();
+
+	start = now();
+	for (i = 0; i < SCROLLS; i++) {
+		scrl(1);
+		mvprintw(lines - 1, 0, "log line %d: the quick brown fox", lines + i);
+		refresh();
+	}
+	report("scroll", lines, cols, SCROLLS, now() - start);
+
+	scrollok(stdscr, FALSE);
+}
+
+
+/******************************************************************************
+ *
+ * benchinput
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Times draining batches of key presses (written to the
+ *                 console's input buffer, or queued with 'wc_meminput',
+ *                 beforehand) with 'getch'.
+ *
+ *****************************************************************************/
+
+void benchinput(int lines, int cols)
+{
+	INPUT_RECORD keys[KEYBATCH];
+	LONGLONG ticks = 0, start;
+	DWORD n;
+	long got = 0;
+	int i;
+
+	/* Make a batch of key presses and releases of the letters */
+	memset(keys, 0, sizeof(keys));
+	for (i = 0; i < KEYBATCH; i++) {
+		keys[i].EventType = KEY_EVENT;
+		keys[i].Event.KeyEvent.bKeyDown = i % 2 == 0;
+		keys[i].Event.KeyEvent.wRepeatCount = 1;
+		keys[i].Event.KeyEvent.wVirtualKeyCode = 'A' + i / 2 % 26;
+		keys[i].Event.KeyEvent.uChar.AsciiChar = 'a' + i / 2 % 26;
+	}
+
+	nodelay(stdscr, TRUE);
+	for (i = 0; i < KEYBATCHES; i++) {
+		if (headless) {
+			if (wc_meminput(keys, KEYBATCH) == ERR) break;
+		}
+		else if (!WriteConsoleInput(wc_inputhandle(), keys, KEYBATCH, &n))
+			break;
+
+		/* Time taking every key press back off of the queue */
+		start = now();
+		while (getch() != ERR) got++;
+		ticks += now() - start;
+	}
+	nodelay(stdscr, FALSE);
+
+	report("input_drain", lines, cols, got, ticks);
+}
+
+
+int main(int argc, char **argv)
+{
+	WINDOW *win;
+	int i, lines, cols;
+	const char *path = "bench_output.txt";
+
+	/* Read our options */
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-vt"))
+			wc_backend(WC_VT);
+		else if (!strcmp(argv[i], "-mem")) {
+			wc_backend(WC_MEMORY);
+			headless = 1;
+		}
+		else
+			path = argv[i];
+	}
+
+	out = fopen(path, "w");
+	if (!out) return 1;
+	QueryPerformanceFrequency(&freq);
+
+	initscr();
+	noecho();
+
+	fprintf(out, "bench,lines,cols,ops,usec,usec_per_op\n");
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		lines = sizes[i][0];
+		cols = sizes[i][1];
+
+		/* Skip sizes which the console can't be made */
+		if (resizeterm(lines, cols) == ERR) {
+			fprintf(out, "waddch,%d,%d,0,0,0\n", lines, cols);
+			fprintf(out, "printw,%d,%d,0,0,0\n", lines, cols);
+			fprintf(out, "refresh_full,%d,%d,0,0,0\n", lines, cols);
+			fprintf(out, "refresh_sparse,%d,%d,0,0,0\n", lines, cols);
+			fprintf(out, "scroll,%d,%d,0,0,0\n", lines, cols);
+			fprintf(out, "input_drain,%d,%d,0,0,0\n", lines, cols);
+			continue;
+		}
+
+		/* Write into a window of our own, so that stdscr starts out blank */
+		win = newwin(lines, cols, 0, 0);
+		if (win) {
+			benchaddch(win, lines, cols);
+			benchprintw(win, lines, cols);
+			delwin(win);
+		}
+
+		benchrefresh(lines, cols);
+		benchscroll(lines, cols);
+		benchinput(lines, cols);
+	}
+
+	endwin();
+	fclose(out);
+
+	return 0;
+}
@@ -18,6 +18,392 @@
 #include "wincurses.h"
 
 
+/* Helper function declarations */
+
+static void cls(HANDLE hcon);
+static int setmode(HANDLE hcon, DWORD bmask);
+static int clearmode(HANDLE hcon, DWORD bmask);
+static int va_wprintw(WINDOW *win, char *fmt, va_list *args);
+static int parsespec(const char **fmt, char *spec, va_list *args, wcarg_t *arg);
+static int fmtarg(char *buf, size_t size, const char *spec, wcarg_t *arg);
+static int putstr(WINDOW *win, const char *str, int n, int *count);
+static WORD getattrs(unsigned int attrs);
+static WORD cellattrs(WINDOW *win, chtype ch);
+static WORD pairmask(short pair);
+static int putcell(WINDOW *win, WCHAR wc, WORD attrs);
+static int utf8dec(const char *s, int n, WCHAR *wc);
+static int utf8enc(WCHAR wc, char *s);
+static int initcells(WINDOW *win);
+static void freecells(WINDOW *win);
+static WINDOW *mkwin(WINDOW *parent, wflags_t flags, int nlines, int ncols,
+		int begin_y, int begin_x);
+static int resizewin(WINDOW *win, int nlines, int ncols, CHAR_INFO *fill);
+static int resizescr(int lines, int columns);
+static int markdirty(WINDOW *win, int y, int first, int last);
+static int fillcells(WINDOW *win, int y, int first, int last, CHAR_INFO fill);
+static CHAR_INFO bkgdcell(WINDOW *win);
+static int overlap(const WINDOW *srcwin, WINDOW *dstwin, int overlay);
+static void blendcells(CHAR_INFO *dst, const CHAR_INFO *src, int n,
+		WCHAR blank);
+static int ownrow(WINDOW *win, int y);
+static int flushcells(WINDOW *win, HANDLE hcon, SMALL_RECT *spans, int n);
+static int diffcells(WINDOW *win, WINDOW *shadow, SMALL_RECT *spans);
+static void *getscratch(size_t len);
+static int readevents(bool wait);
+static int waitkeys(int delay);
+static int frametick(void);
+static size_t framelen(WINDOW *win);
+static int drawframe(WINDOW *win, void *mem);
+static int postframe(void);
+static DWORD WINAPI renderloop(LPVOID arg);
+static void renderwait(void);
+static WINDOW *mkframe(void);
+static void freeframe(WINDOW *win);
+static int spancells(SMALL_RECT *spans, int n);
+static void statstop(int phase);
+static bool checksize(void);
+static int mapkey(wcevent_t *c);
+static COORD tocoord(wcoord_t pos);
+static int newline(WINDOW *win);
+static int shiftcells(WINDOW *win, int top, int bot, int n, CHAR_INFO fill);
+static ULONGLONG linehash(WINDOW *win, int y);
+static int findscroll(WINDOW *win, WINDOW *shadow, DWORD *same, int *top,
+		int *bot);
+
+static int coninit(void);
+static int conscroll(int top, int bot, int n);
+static int conshift(HANDLE hcon, int top, int bot, int n);
+static int conflush(WINDOW *win, SMALL_RECT *spans, int n);
+static int conresize(int lines, int cols);
+static int consize(HANDLE hcon, int lines, int cols);
+static int concurs(int visibility);
+static int conread(INPUT_RECORD *recs, DWORD len, DWORD *n, bool wait);
+static int conwinsize(int *lines, int *cols);
+static int conend(void);
+
+static int vtinit(void);
+static int vtscroll(int top, int bot, int n);
+static int vtflush(WINDOW *win, SMALL_RECT *spans, int n);
+static int vtresize(int lines, int cols);
+static int vtcurs(int visibility);
+static int vtend(void);
+static char *vtreserve(size_t len);
+static int vtput(const char *s, size_t len);
+static int vtint(int n);
+static int vtintlen(int n);
+static int vtsgr(WORD attrs);
+static int vtmove(WINDOW *win, int y, int x);
+static int vtcolcost(WINDOW *win, int y, int from, int x, int limit, int *how);
+static int vtcolmove(WINDOW *win, int y, int from, int x, int how);
+static int vtblanks(WINDOW *win, int y, WORD *attrs);
+static int vtwrite(void);
+
+static int meminit(void);
+static int memscroll(int top, int bot, int n);
+static int memflush(WINDOW *win, SMALL_RECT *spans, int n);
+static int memresize(int lines, int cols);
+static int memcurs(int visibility);
+static int memread(INPUT_RECORD *recs, DWORD len, DWORD *n, bool wait);
+static int memwinsize(int *lines, int *cols);
+static int memend(void);
+
+
+/* The console API output backend */
+static output_t conoutput = {
+	coninit, conscroll, conflush, conresize, concurs, conread, conwinsize,
+	conend
+};
+
+/* The virtual terminal output backend (which reads the console's input) */
+static output_t vtoutput = {
+	vtinit, vtscroll, vtflush, vtresize, vtcurs, conread, conwinsize, vtend
+};
+
+/* The headless memory backend */
+static output_t memoutput = {
+	meminit, memscroll, memflush, memresize, memcurs, memread, memwinsize,
+	memend
+};
+
+/*
+ * The library's state. The screens, their size, the number of colors and
+ * pairs, and the key map are part of the interface (see wincurses.h); the
+ * rest is only used here.
+ */
+WINDOW *stdscr;
+WINDOW *newscr;
+WINDOW *curscr;
+int LINES;
+int COLS;
+int COLORS;
+int COLOR_PAIRS;
+
+/* Color value */
+static color_t colors[NUM_COLORS];
+
+/* Handle for restoring standard output later on */
+static HANDLE hstdout;
+
+/* Handle to input buffer */
+static HANDLE hstdin;
+
+/* Standard console cursor size */
+static DWORD cursize;
+
+/* The quick edit mode to put back when 'wc_mouse' turns reporting off */
+static DWORD quickedit;
+
+/* The output backend requested with 'wc_backend' and the one in use */
+static int backend;
+static output_t *output;
+
+/*
+ * Two handles to console screen buffers used by the console backend. (Only one
+ * is active at a time, while the other is used as a back buffer.) In single
+ * buffer mode, only the first handle is used.
+ */
+static HANDLE hcon[2];
+
+/*
+ * The indices of the console screen buffer being used as the primary and back
+ * buffer. (These are equal in single buffer mode.)
+ */
+static int prim, bbuf;
+
+/*
+ * A scroll already made to the back buffer which the primary buffer must
+ * catch up with once it is no longer on display. (Nothing is pending when
+ * 'scrn' is zero.)
+ */
+static int scrtop, scrbot, scrn;
+
+/*
+ * Whether the primary buffer may no longer hold what 'curscr' says it does,
+ * because the console rearranged its contents when it was resized. (It is
+ * rewritten in full the next time it is hidden.)
+ */
+static bool constale;
+
+/*
+ * Bytes waiting to be written by the virtual terminal backend, how many there
+ * are, and how many fit before the buffer must grow.
+ */
+static char *vtbuf;
+static size_t vtlen, vtsize;
+
+/*
+ * Where the terminal's cursor is and the attributes it is drawing with, as
+ * far as the virtual terminal backend knows. (Negative values are unknown.)
+ */
+static COORD vtcur;
+static int vtattr;
+
+/* The cursor visibility last set by the virtual terminal backend */
+static int vtvis;
+
+/* The console output mode to restore after using virtual terminal sequences */
+static DWORD vtmode;
+
+/* The console output code page to restore after writing UTF-8 */
+static UINT vtcp;
+
+/* The cells the memory backend shows, row after row, and how many there are */
+static CHAR_INFO *memcells;
+static COORD memsize;
+
+/*
+ * The size of the memory backend's window, as far as 'checksize' is
+ * concerned. (It changes with 'resizeterm', and with scripted size change
+ * records as they are read.)
+ */
+static COORD memwin;
+
+/* Where the memory backend's cursor is, and its visibility */
+static COORD memcur;
+static int memvis;
+
+/*
+ * Input records queued for the memory backend with 'wc_meminput', the
+ * position of the next one to read, how many are queued, and how many fit
+ * before the queue must grow. (The memory backend's input handle is an event
+ * which is set while records are waiting.)
+ */
+static INPUT_RECORD *memin;
+static size_t memhead, meminlen, meminsize;
+
+/*
+ * Input events read from the console but not yet returned by 'wgetch' or
+ * 'wc_poll', and the positions to take the next one from and to put the next
+ * one at. (The positions only ever increase, and are taken modulo 'WC_EVQ'.)
+ */
+static wcevent_t evq[WC_EVQ];
+static unsigned int evhead, evtail;
+
+/* Handles registered with 'wc_addhandle', their pointers, and how many */
+static HANDLE uhandles[WC_MAXHANDLES];
+static void *udata[WC_MAXHANDLES];
+static int nhandles;
+
+/*
+ * The delay set by 'halfdelay' in tenths of a second, which overrides the
+ * delay of every window. (Zero when not in half-delay mode.)
+ */
+static int hdelay;
+
+/* Program flags */
+static flags_t flags;
+
+/* Color pair data */
+static colorinfo_t color_pairs[MAX_NUM_PAIRS];
+
+/*
+ * The console color flags for each color pair, worked out whenever the pair
+ * or one of its colors is set (see 'pairmask') so that 'getattrs' only has to
+ * look them up
+ */
+static WORD pairattrs[MAX_NUM_PAIRS];
+
+/*
+ * Scratch memory shared by 'refresh' and the output functions, and its size
+ * in bytes. (It is only reallocated when more space is needed, such as after
+ * the console grows, so steady-state output makes no heap allocations.)
+ */
+static void *scratch;
+static size_t scratchlen;
+
+/* The largest gap of unchanged cells bridged by 'refresh' */
+static int spangap;
+
+/*
+ * The number of console output calls made by the last frame written (by the
+ * render thread, if there is one)
+ */
+static int concalls;
+
+/*
+ * The fewest milliseconds between writing one frame to the console and the
+ * next, or zero to write every refresh straight away (see 'wc_framerate'),
+ * when the last frame was written, and whether a refresh is being held back
+ */
+static int framems;
+static DWORD lastframe;
+static bool framestale;
+
+/*
+ * The render thread started by 'wc_render' (or NULL if there is none), the
+ * event which wakes it up, the event it signals whenever it runs out of
+ * frames to draw, and whether it has been asked to stop
+ */
+static HANDLE rthread, rwake, ridle;
+static volatile bool rstop;
+
+/*
+ * The last generation asked for by 'renderwait', and the last one the render
+ * thread has drawn every frame for
+ */
+static volatile LONG rasked, rdone;
+
+/*
+ * The frames handed from 'wc_flush' to the render thread: the one filled with
+ * the next copy of 'newscr', the one being handed over, and the one being
+ * drawn. (Like 'prim' and 'bbuf', their roles are swapped rather than their
+ * cells copied, but 'rmid' is swapped with one atomic exchange so that
+ * neither thread ever waits for the other.)
+ */
+static WINDOW *rback, *volatile rmid, *rfront;
+
+/*
+ * Held while 'newscr', the scratch memory or the output backend is in use, so
+ * that windows can be refreshed from any thread (see 'THREADS')
+ */
+static CRITICAL_SECTION scrlock;
+
+/*
+ * The counts kept for 'wc_stats', when each phase was last started, and the
+ * performance counter ticks spent in each phase (only kept when WC_STATS is
+ * defined)
+ */
+static wcstats_t stats;
+static LARGE_INTEGER phasestart[WC_PHASES];
+static LONGLONG phaseticks[WC_PHASES];
+
+
+/*
+ * Key codes for each virtual key code, with no modifier keys held and with
+ * shift, control and alt held (see '_keymods_t'). Zero means a key has no key
+ * code with those modifiers: the key code without modifiers is used instead,
+ * if there is one, or else the key's character is passed on.
+ *
+ * Shifted, controlled and alternate function keys are numbered after the ones
+ * before them, so that shift-F1 is F13, control-F1 is F25 and alt-F1 is F49.
+ */
+int keymap[256][WC_MODS] = {
+	/*                   Plain             Shift           Control      Alt */
+	[VK_CANCEL]      = { KEY_CANCEL,       KEY_SCANCEL },
+	[VK_BACK]        = { KEY_BACKSPACE },
+	[VK_TAB]         = { 0,                KEY_BTAB },
+	[VK_CLEAR]       = { KEY_CLEAR },
+	[VK_RETURN]      = { KEY_ENTER },
+	[VK_CONTROL]     = { KEY_COMMAND,      KEY_SCOMMAND },
+	[VK_PAUSE]       = { KEY_BREAK },
+	[VK_ESCAPE]      = { KEY_EXIT,         KEY_SEXIT },
+	[VK_PRIOR]       = { KEY_PPAGE,        KEY_SPREVIOUS },
+	[VK_NEXT]        = { KEY_NPAGE,        KEY_SNEXT },
+	[VK_END]         = { KEY_END,          KEY_SEND },
+	[VK_HOME]        = { KEY_HOME,         KEY_SHOME },
+	[VK_LEFT]        = { KEY_LEFT,         KEY_SLEFT },
+	[VK_UP]          = { KEY_UP,           KEY_SR },
+	[VK_RIGHT]       = { KEY_RIGHT,        KEY_SRIGHT },
+	[VK_DOWN]        = { KEY_DOWN,         KEY_SF },
+	[VK_SELECT]      = { KEY_SELECT },
+	[VK_PRINT]       = { KEY_PRINT,        KEY_SPRINT },
+	[VK_EXECUTE]     = { KEY_COMMAND,      KEY_SCOMMAND },
+	[VK_SNAPSHOT]    = { KEY_PRINT,        KEY_SPRINT },
+	[VK_INSERT]      = { KEY_IC,           KEY_SIC },
+	[VK_DELETE]      = { KEY_DC,           KEY_SDC },
+	[VK_HELP]        = { KEY_HELP,         KEY_SHELP },
+	[VK_APPS]        = { KEY_OPTIONS,      KEY_SOPTIONS },
+	[VK_SLEEP]       = { KEY_SUSPEND,      KEY_SSUSPEND },
+	[VK_NUMPAD1]     = { KEY_C1 },
+	[VK_NUMPAD2]     = { KEY_DOWN },
+	[VK_NUMPAD3]     = { KEY_C3 },
+	[VK_NUMPAD4]     = { KEY_LEFT },
+	[VK_NUMPAD5]     = { KEY_B2 },
+	[VK_NUMPAD6]     = { KEY_RIGHT },
+	[VK_NUMPAD7]     = { KEY_A1 },
+	[VK_NUMPAD8]     = { KEY_UP },
+	[VK_NUMPAD9]     = { KEY_A3 },
+	[VK_F1]          = { KEY_F(1),         KEY_F(13),      KEY_F(25),   KEY_F(49) },
+	[VK_F2]          = { KEY_F(2),         KEY_F(14),      KEY_F(26),   KEY_F(50) },
+	[VK_F3]          = { KEY_F(3),         KEY_F(15),      KEY_F(27),   KEY_F(51) },
+	[VK_F4]          = { KEY_F(4),         KEY_F(16),      KEY_F(28),   KEY_F(52) },
+	[VK_F5]          = { KEY_F(5),         KEY_F(17),      KEY_F(29),   KEY_F(53) },
+	[VK_F6]          = { KEY_F(6),         KEY_F(18),      KEY_F(30),   KEY_F(54) },
+	[VK_F7]          = { KEY_F(7),         KEY_F(19),      KEY_F(31),   KEY_F(55) },
+	[VK_F8]          = { KEY_F(8),         KEY_F(20),      KEY_F(32),   KEY_F(56) },
+	[VK_F9]          = { KEY_F(9),         KEY_F(21),      KEY_F(33),   KEY_F(57) },
+	[VK_F10]         = { KEY_F(10),        KEY_F(22),      KEY_F(34),   KEY_F(58) },
+	[VK_F11]         = { KEY_F(11),        KEY_F(23),      KEY_F(35),   KEY_F(59) },
+	[VK_F12]         = { KEY_F(12),        KEY_F(24),      KEY_F(36),   KEY_F(60) },
+	[VK_F13]         = { KEY_F(13) },
+	[VK_F14]         = { KEY_F(14) },
+	[VK_F15]         = { KEY_F(15) },
+	[VK_F16]         = { KEY_F(16) },
+	[VK_F17]         = { KEY_F(17) },
+	[VK_F18]         = { KEY_F(18) },
+	[VK_F19]         = { KEY_F(19) },
+	[VK_F20]         = { KEY_F(20) },
+	[VK_F21]         = { KEY_F(21) },
+	[VK_F22]         = { KEY_F(22) },
+	[VK_F23]         = { KEY_F(23) },
+	[VK_F24]         = { KEY_F(24) },
+	[VK_BROWSER_BACK]    = { KEY_PREVIOUS, KEY_SPREVIOUS },
+	[VK_BROWSER_FORWARD] = { KEY_NEXT,     KEY_SNEXT },
+	[VK_BROWSER_REFRESH] = { KEY_REFRESH },
+	[VK_BROWSER_SEARCH]  = { KEY_FIND,     KEY_SFIND }
+};
+
+
 /******************************************************************************
  *
  * initscr
@@ -28,6 +414,13 @@
  *                 allocates memory for 'stdscr', sets 'stdscr' up with its
  *                 default values, and creates the primary and back buffers.
  *
+ *                 If single buffer mode was requested with 'wc_singlebuf', only
+ *                 one console buffer is created and written to directly.
+ *
+ *                 With the memory backend (see 'wc_backend'), the console is
+ *                 not touched at all and the screen starts out 'WC_MEMLINES'
+ *                 rows by 'WC_MEMCOLS' columns.
+ *
  * RETURN VALUE:   If successful, returns a pointer to 'stdscr' -- the default
  *                 window. Otherwise, an 'exit' call is made and control is
  *                 never returned to the caller.
@@ -49,72 +442,130 @@ WINDOW *initscr(void)
 	/* Sanity check: successfully allocated a screen */
 	if (!stdscr) exit(1);
 
-	/* Set up our primary and back buffer indices */
-	stdscr->bbuf = !(stdscr->prim = 0);
+	/* Use the output backend requested with 'wc_backend' (see below) */
+	output = backend == WC_VT ? &vtoutput
+			: backend == WC_MEMORY ? &memoutput : &conoutput;
 
-	/* Get and set up console information */
-	if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &coninfo))
-		exit(1);
-	stdscr->rect = coninfo.srWindow;
-	stdscr->size.Y = stdscr->rect.Bottom - stdscr->rect.Top + 1;
-	stdscr->size.X = stdscr->rect.Right - stdscr->rect.Left + 1;
+	if (output == &memoutput) {
+		/* There is no console to ask, so start out at the default size */
+		stdscr->size.Y = WC_MEMLINES;
+		stdscr->size.X = WC_MEMCOLS;
+	}
+	else {
+		/* Get and set up console information */
+		if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE),
+				&coninfo))
+			exit(1);
+		stdscr->size.Y = coninfo.srWindow.Bottom - coninfo.srWindow.Top + 1;
+		stdscr->size.X = coninfo.srWindow.Right - coninfo.srWindow.Left + 1;
+
+		/* Save a handle to our (soon to be) old console buffer */
+		hstdout = GetStdHandle(STD_OUTPUT_HANDLE);
+
+		/* Sanity check: able to get handle */
+		if (hstdout == INVALID_HANDLE_VALUE) exit(1);
+
+		/* Grab our standard cursor size */
+		GetConsoleCursorInfo(hstdout, &curinfo);
+		cursize = curinfo.dwSize;
+
+		/* Get a handle to our input buffer */
+		hstdin = GetStdHandle(STD_INPUT_HANDLE);
+
+		/* Sanity check: able to get handle */
+		if (hstdin == INVALID_HANDLE_VALUE) exit(1);
+	}
 	LINES = stdscr->size.Y;
 	COLS = stdscr->size.X;
 
+	/* Stdscr covers the whole screen and is not a subwindow */
+	stdscr->rect.Top = stdscr->rect.Left = 0;
+	stdscr->rect.Bottom = stdscr->size.Y - 1;
+	stdscr->rect.Right = stdscr->size.X - 1;
+	stdscr->parent = NULL;
+	stdscr->org.Y = stdscr->org.X = 0;
+	stdscr->nsub = 0;
+
 	/* Set cursor position to origin (0, 0) */
 	stdscr->cur.Y = stdscr->cur.X = 0;
 
-	/* Create our console buffers */
-	stdscr->hcon[stdscr->prim] = CreateConsoleScreenBuffer(
-			GENERIC_WRITE | GENERIC_READ,
-			FILE_SHARE_WRITE | FILE_SHARE_READ,
-			NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+	/*
+	 * Start with no window-specific flags, the whole window scrolling, and
+	 * input functions waiting for a key press
+	 */
+	stdscr->flags = 0;
+	stdscr->top = 0;
+	stdscr->bot = stdscr->size.Y - 1;
+	stdscr->delay = -1;
 
-	/* Sanity check: console buffer successfully created */
-	if (stdscr->hcon[stdscr->prim] == INVALID_HANDLE_VALUE) exit(1);
+	/* Set any window attributes initially to grey text, black background */
+	stdscr->attrs = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
 
-	stdscr->hcon[stdscr->bbuf] = CreateConsoleScreenBuffer(
-			GENERIC_WRITE | GENERIC_READ,
-			FILE_SHARE_WRITE | FILE_SHARE_READ,
-			NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+	/* Clear to blanks with the window's attributes (see 'bkgdcell') */
+	stdscr->bkgd = A_NORMAL;
 
-	/* Sanity check: console buffer successfully created */
-	if (stdscr->hcon[stdscr->bbuf] == INVALID_HANDLE_VALUE) exit(1);
+	/* Allocate the in-memory cells that output functions write to */
+	if (initcells(stdscr) == ERR) exit(1);
 
-	/* Set the size of our buffers to match the window size */
-	if (!SetConsoleScreenBufferSize(stdscr->hcon[stdscr->prim], stdscr->size))
-		exit(1);
-	if (!SetConsoleScreenBufferSize(stdscr->hcon[stdscr->bbuf], stdscr->size))
-		exit(1);
+	/* Set up the locks which let other threads draw (see 'THREADS') */
+	stdscr->lock = malloc(sizeof(CRITICAL_SECTION));
+	if (!stdscr->lock) exit(1);
+	InitializeCriticalSection(stdscr->lock);
+	InitializeCriticalSection(&scrlock);
 
-	/* Clear our buffers */
-	cls(stdscr->hcon[stdscr->prim]);
-	cls(stdscr->hcon[stdscr->bbuf]);
+	/* Allocate memory for newscr, which windows are copied onto */
+	newscr = malloc(sizeof(WINDOW));
+
+	/* Sanity check: successfully allocated a screen */
+	if (!newscr) exit(1);
+
+	/* Newscr starts out blank, like stdscr */
+	*newscr = *stdscr;
+	if (initcells(newscr) == ERR) exit(1);
 
-	/* Save a handle to our (soon to be) old console buffer */
-	hstdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	/* Allocate memory for curscr, which mirrors the console */
+	curscr = malloc(sizeof(WINDOW));
 
-	/* Sanity check: able to get handle */
-	if (hstdout == INVALID_HANDLE_VALUE) exit(1);
+	/* Sanity check: successfully allocated a screen */
+	if (!curscr) exit(1);
 
-	/* Grab our standard cursor size */
-	GetConsoleCursorInfo(hstdout, &curinfo);
-	cursize = curinfo.dwSize;
+	/* Curscr is only ever compared against */
+	*curscr = *stdscr;
+	if (initcells(curscr) == ERR) exit(1);
 
-	/* Get a handle to our input buffer */
-	hstdin = GetStdHandle(STD_INPUT_HANDLE);
+	/*
+	 * Nothing is known to be on the console yet, so make sure that every cell
+	 * differs from newscr and gets written by the first update.
+	 */
+	memset(curscr->cells, 0, sizeof(CHAR_INFO) * curscr->size.Y * curscr->size.X);
 
-	/* Sanity check: able to get handle */
-	if (hstdin == INVALID_HANDLE_VALUE) exit(1);
+	/* Set aside enough scratch memory to hold a screenful of cells */
+	if (!getscratch(sizeof(CHAR_INFO) * LINES * COLS)) exit(1);
 
-	/* Set any window attributes initially to grey text, black background */
-	stdscr->attrs = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+	/*
+	 * Set up the requested output backend, falling back on the console API if
+	 * it is not supported (such as virtual terminal sequences before Windows
+	 * 10).
+	 */
+	if (output->init() == ERR) {
+		if (output != &vtoutput) exit(1);
+		output = &conoutput;
+		if (output->init() == ERR) exit(1);
+	}
 
-	/* Start with a clean console mode */
-	if (!SetConsoleMode(hstdin, 0)) exit(1);
+	/*
+	 * Start out joining spans with the default gap. (The virtual terminal
+	 * backend decides for itself when rewriting unchanged cells is cheaper
+	 * than moving the cursor past them.)
+	 */
+	spangap = output == &vtoutput ? 0 : WC_SPANGAP;
 
-	/* Set the primary buffer as the current console screen buffer */
-	if (!SetConsoleActiveScreenBuffer(stdscr->hcon[stdscr->prim])) exit(1);
+	/*
+	 * Start with a clean console mode, except for having the console tell us
+	 * when its size changes (see 'wc_poll')
+	 */
+	if (output != &memoutput && !SetConsoleMode(hstdin, ENABLE_WINDOW_INPUT))
+		exit(1);
 
 	/* Return the default window (stdscr) */
 	return stdscr;
@@ -127,8 +578,9 @@ WINDOW *initscr(void)
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Updates the console by swapping the primary and back
- *                 buffers.
+ * DESCRIPTION:    Updates the console with the changed cells of 'stdscr'.
+ *
+ *                 (See 'wrefresh' for more information.)
  *
  * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
@@ -136,50 +588,206 @@ WINDOW *initscr(void)
 
 int refresh(void)
 {
-	CHAR_INFO *tbuf;
-	COORD size, orig;
+	return wrefresh(stdscr);
+}
 
-	/* Set the back buffer as the current console screen buffer */
-	SetConsoleActiveScreenBuffer(stdscr->hcon[stdscr->bbuf]);
 
-	/* Move our cursor to the correct position */
-	SetConsoleCursorPosition(stdscr->hcon[stdscr->bbuf], stdscr->cur);
+/******************************************************************************
+ *
+ * wrefresh
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Updates the console with the changed cells of the window
+ *                 pointed to by 'win'.
+ *
+ *                 This is the same as calling 'wnoutrefresh' and then
+ *                 'doupdate'. When several windows change at once, calling
+ *                 'wnoutrefresh' for each of them and then 'doupdate' once is
+ *                 faster.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
 
-	/*
-	 * Copy the contents of the back buffer to the primary buffer for
-	 * persistency. (Remember: the buffers are swapped IN APPEARANCE at this
-	 * point, but not IN NOTATION. Basically, we are currently looking at
-	 * hcon[bbuf] from the console, so we want to copy from hcon[bbuf] to
-	 * hcon[prim], which is our new back buffer (even though we haven't updated
-	 * the values of 'bbuf' and 'prim' yet).
-	 */
+int wrefresh(WINDOW *win)
+{
+	if (wnoutrefresh(win) == ERR) return ERR;
+	return doupdate();
+}
 
-	/* Allocate enough memory for the temporary buffer */
-	tbuf = malloc(sizeof(CHAR_INFO) * stdscr->size.Y * stdscr->size.X);
 
-	/* We want to start at (0, 0) and have size (Y, X) */
-	orig.Y = orig.X = 0;
-	size.Y = stdscr->size.Y;
-	size.X = stdscr->size.X;
+/******************************************************************************
+ *
+ * wnoutrefresh
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the changed cells of the window pointed to by 'win'
+ *                 onto 'newscr', covering whatever was there, and moves the
+ *                 cursor of 'newscr' to where the window's cursor is. Nothing
+ *                 is written to the console until 'doupdate' is called.
+ *
+ *                 Afterwards, every row of 'win' is marked as unchanged.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when 'win' is a pad. (See 'pnoutrefresh'.)
+ *
+ *****************************************************************************/
+
+int wnoutrefresh(WINDOW *win)
+{
+	int y, sy, sx, last;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Sanity check: pads have no place on the screen of their own */
+	if (win->flags & WC_PAD) return ERR;
+
+	/* Make sure nobody else is drawing in the window or the screen */
+	EnterCriticalSection(win->lock);
+	EnterCriticalSection(&scrlock);
+	WC_START(WC_PBUILD);
 
-	/* Read the output from stdscr */
-	ReadConsoleOutput(stdscr->hcon[stdscr->bbuf], tbuf, size, orig,
-			&stdscr->rect);
+	/* Pass a request to redraw the screen on to 'doupdate' */
+	if (win->flags & WC_CLEAROK) {
+		curscr->flags |= WC_CLEAROK;
+		win->flags &= ~WC_CLEAROK;
+	}
+
+	for (y = 0; y < win->size.Y; y++) {
+		/* Only copy rows which have changed */
+		if (win->firstch[y] == WC_NOCHANGE) continue;
+
+		/*
+		 * Copy the changed cells to where they go on the screen, leaving out
+		 * any which are off of it (since the screen may have shrunk)
+		 */
+		sy = win->rect.Top + y;
+		sx = win->rect.Left + win->firstch[y];
+		last = win->rect.Left + win->lastch[y];
+		if (last >= newscr->size.X) last = newscr->size.X - 1;
+		if (sy < newscr->size.Y && sx <= last) {
+			markdirty(newscr, sy, sx, last);
+			memcpy(&newscr->line[sy][sx], &win->line[y][win->firstch[y]],
+					sizeof(CHAR_INFO) * (last - sx + 1));
+		}
 
-	/* Copy from the temporary buffer to the primary buffer */
-	WriteConsoleOutput(stdscr->hcon[stdscr->prim], tbuf, size, orig,
-			&stdscr->rect);
+		win->firstch[y] = win->lastch[y] = WC_NOCHANGE;
+	}
 
-	/* Free our temporary buffer */
-	free(tbuf);
+	/* Put the screen's cursor where the window's is, if it is on the screen */
+	if (win->cur.Y < win->size.Y && win->rect.Top + win->cur.Y < newscr->size.Y
+			&& win->rect.Left + win->cur.X < newscr->size.X) {
+		newscr->cur.Y = win->rect.Top + win->cur.Y;
+		newscr->cur.X = win->rect.Left + win->cur.X;
+	}
 
-	/* 'Swap' the primary and back buffers by swapping their values */
-	stdscr->bbuf = !(stdscr->prim = !stdscr->prim);
+	WC_STOP(WC_PBUILD);
+	LeaveCriticalSection(&scrlock);
+	LeaveCriticalSection(win->lock);
 
 	return OK;
 }
 
 
+/******************************************************************************
+ *
+ * doupdate
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Updates the console with the changed cells of 'newscr',
+ *                 which holds every window copied there by 'wnoutrefresh'.
+ *                 (See 'wc_flush'.)
+ *
+ *                 If a frame rate limit is set (see 'wc_framerate') and the
+ *                 last frame was written too recently, nothing is written.
+ *                 The changes stay in 'newscr', along with any made before the
+ *                 next frame is written, which happens when the input
+ *                 functions next wait, or on the first refresh after the
+ *                 limit has passed.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+int doupdate(void)
+{
+	int r;
+
+	/* Only one thread may update the screen at a time */
+	EnterCriticalSection(&scrlock);
+
+	/* Hold the frame back if the last one was written too recently */
+	if (framems > 0 && GetTickCount() - lastframe < (DWORD)framems) {
+		framestale = TRUE;
+		r = OK;
+	}
+	else
+		r = wc_flush();
+
+	LeaveCriticalSection(&scrlock);
+
+	return r;
+}
+
+
+/******************************************************************************
+ *
+ * wc_flush
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Updates the console with the changed cells of 'newscr'
+ *                 straight away, whatever the frame rate limit (see
+ *                 'wc_framerate').
+ *
+ *                 If a render thread is running (see 'wc_render'), the frame
+ *                 is handed to it instead and written in the background.
+ *                 Otherwise, it is written before returning. (See
+ *                 'drawframe'.)
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+int wc_flush(void)
+{
+	void *mem;
+	int r;
+
+	/* Only one thread may update the screen at a time */
+	EnterCriticalSection(&scrlock);
+
+	/* This is the frame which was being held back, if any */
+	lastframe = GetTickCount();
+	framestale = FALSE;
+
+	/* Pass a request to redraw the screen (see 'clearok') on with the frame */
+	if (curscr->flags & WC_CLEAROK) {
+		newscr->flags |= WC_CLEAROK;
+		curscr->flags &= ~WC_CLEAROK;
+	}
+
+	/*
+	 * Hand the frame to the render thread if there is one, or otherwise
+	 * borrow scratch memory to draw it with
+	 */
+	if (rthread)
+		r = postframe();
+	else {
+		mem = getscratch(framelen(newscr));
+		r = mem ? drawframe(newscr, mem) : ERR;
+	}
+
+	LeaveCriticalSection(&scrlock);
+
+	return r;
+}
+
+
 /******************************************************************************
  *
  * endwin
@@ -200,13 +808,33 @@ int refresh(void)
 
 int endwin(void)
 {
-	/* Restore our saved stdout */
-	SetConsoleActiveScreenBuffer(hstdout);
+	/* Write out any frame held back by the frame rate limit */
+	if (framestale) wc_flush();
+
+	/* Stop the render thread once it has written everything out */
+	wc_render(FALSE);
+
+	/* Restore the console to the way the output backend found it */
+	output->end();
 
 	/* TODO: Don't clean up after stdscr */
-	/* Close the handle to our buffers */
-	CloseHandle(stdscr->hcon[stdscr->prim]);
-	CloseHandle(stdscr->hcon[stdscr->bbuf]);
+
+	/* Free curscr and newscr */
+	freecells(curscr);
+	free(curscr);
+	freecells(newscr);
+	free(newscr);
+
+	/* Free our scratch memory */
+	free(scratch);
+	scratch = NULL;
+	scratchlen = 0;
+
+	/* Free the cells of stdscr, and the locks */
+	freecells(stdscr);
+	DeleteCriticalSection(stdscr->lock);
+	free(stdscr->lock);
+	DeleteCriticalSection(&scrlock);
 
 	/* Free the stdscr pointer */
 	free(stdscr);
@@ -217,172 +845,230 @@ int endwin(void)
 
 /******************************************************************************
  *
- * addch
+ * newwin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Adds the character 'ch' to 'stdscr' starting at the current
- *                 cursor location and increments the cursor location when done
- *                 to the location immediately following the written character.
+ * DESCRIPTION:    Creates a new window with 'nlines' rows and 'ncols' columns
+ *                 whose upper left corner is at ('begin_y', 'begin_x') on the
+ *                 screen. If 'nlines' or 'ncols' is zero, the window reaches
+ *                 to the bottom or right edge of the screen.
  *
- *                 The cursor is advanced to the beginning of the next line if,
- *                 after writing the character, the cursor would run past the
- *                 end of a row in the console buffer.
+ *                 A window is only a grid of cells in memory. It is shown with
+ *                 'wrefresh', or with 'wnoutrefresh' and 'doupdate'.
  *
- * RETURN VALUE:   Returns OK if the character was successfully written.
- *                 Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns a pointer to the new window. Otherwise, NULL is
+ *                 returned, such as when the window does not fit on the
+ *                 screen.
+ *
+ * NOTES:          Call 'delwin' to free the window when done with it.
  *
  *****************************************************************************/
 
-int addch(const chtype ch)
+WINDOW *newwin(int nlines, int ncols, int begin_y, int begin_x)
 {
-	return waddch(stdscr, ch);
+	/* Zero means the rest of the screen */
+	if (!nlines) nlines = LINES - begin_y;
+	if (!ncols) ncols = COLS - begin_x;
+
+	/* Sanity check: within bounds? */
+	if (begin_y < 0 || begin_x < 0 || nlines <= 0 || ncols <= 0
+			|| begin_y + nlines > LINES || begin_x + ncols > COLS)
+		return NULL;
+
+	return mkwin(NULL, 0, nlines, ncols, begin_y, begin_x);
 }
 
 
 /******************************************************************************
  *
- * mvaddch
+ * subwin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x'), adds a
- *                 character at that position, and increments the cursor
- *                 location when done to the location immediately following the
- *                 written character.
+ * DESCRIPTION:    Creates a subwindow of the window pointed to by 'orig' whose
+ *                 upper left corner is at ('begin_y', 'begin_x') on the
+ *                 screen.
  *
- *                 (See 'addch' for more information.)
+ *                 (See 'derwin' for more information.)
  *
- * RETURN VALUE:   Returns OK if the character was successfully written.
- *                 Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns a pointer to the new window. Otherwise, NULL is
+ *                 returned.
  *
  *****************************************************************************/
 
-int mvaddch(int y, int x, const chtype ch)
+WINDOW *subwin(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x)
 {
-	return mvwaddch(stdscr, y, x, ch);
+	/* Sanity check: NULL pointer */
+	if (!orig) return NULL;
+
+	return derwin(orig, nlines, ncols, begin_y - orig->rect.Top,
+			begin_x - orig->rect.Left);
 }
 
 
 /******************************************************************************
  *
- * mvwaddch
+ * derwin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x'), adds a
- *                 character at that position, and increments the cursor
- *                 location when done to the location immediately following the
- *                 written character.
+ * DESCRIPTION:    Creates a subwindow with 'nlines' rows and 'ncols' columns
+ *                 whose upper left corner is at ('begin_y', 'begin_x') within
+ *                 the window pointed to by 'orig'. If 'nlines' or 'ncols' is
+ *                 zero, the subwindow reaches to the bottom or right edge of
+ *                 'orig'.
  *
- *                 (See 'addch' for more information.)
+ *                 A subwindow shares the cells of 'orig', so writing to either
+ *                 window changes both. Changes made through the subwindow are
+ *                 also marked as changes to 'orig'.
  *
- * RETURN VALUE:   Returns OK if the character was successfully written.
- *                 Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns a pointer to the new window. Otherwise, NULL is
+ *                 returned, such as when the subwindow does not fit within
+ *                 'orig'.
+ *
+ * NOTES:          Call 'delwin' to free the subwindow before 'orig'.
  *
  *****************************************************************************/
 
-int mvwaddch(WINDOW *win, int y, int x, const chtype ch)
+WINDOW *derwin(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x)
 {
-	if (wmove(win, y, x) == ERR)
-		return ERR;
-	return waddch(win, ch);
+	/* Sanity check: NULL pointer */
+	if (!orig) return NULL;
+
+	/* Zero means the rest of the window */
+	if (!nlines) nlines = orig->size.Y - begin_y;
+	if (!ncols) ncols = orig->size.X - begin_x;
+
+	/* Sanity check: within bounds? */
+	if (begin_y < 0 || begin_x < 0 || nlines <= 0 || ncols <= 0
+			|| begin_y + nlines > orig->size.Y
+			|| begin_x + ncols > orig->size.X)
+		return NULL;
+
+	/* Subwindows of pads are pads too */
+	return mkwin(orig, orig->flags & WC_PAD, nlines, ncols, begin_y, begin_x);
 }
 
 
 /******************************************************************************
  *
- * waddch
+ * delwin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Adds the character 'ch' to 'win' starting at the current
- *                 cursor location and increments the cursor location when done
- *                 to the location immediately following the written character.
- *
- *                 (See 'addch' for more information.)
- *
- * RETURN VALUE:   Returns OK if the character was successfully written.
- *                 Otherwise, ERR is returned.
+ * DESCRIPTION:    Frees the window pointed to by 'win'. Whatever the window
+ *                 put on the screen stays there until something covers it.
  *
- * NOTES:          Handle 'special' characters (backspace, etc.)
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the window still has subwindows.
  *
  *****************************************************************************/
 
-int waddch(WINDOW *win, const chtype ch)
+int delwin(WINDOW *win)
 {
-	CHAR_INFO c;
-	COORD size = {1, 1};
-	COORD origin = {0, 0};
-	SMALL_RECT rect = {0, 0, 0, 0};
-
 	/* Sanity check: NULL pointer */
 	if (!win) return ERR;
 
-	/* Set up our region to write to */
-	rect.Top = win->cur.Y;
-	rect.Bottom = win->cur.Y + size.Y;
-	rect.Left = win->cur.X;
-	rect.Right = win->cur.X + size.X;
+	/* Sanity check: no subwindows still share our cells */
+	if (win->nsub) return ERR;
 
-	/* Set up our character for output */
-	c.Char.AsciiChar = ch;
-	c.Char.UnicodeChar = ch;
-	c.Attributes = win->attrs;
-
-	/* TODO: Handle special characters */
-	/* Check for a special character */
-	switch (ch) {
-		case '\r':		/* Carriage return */
-			/* Advance the character to the beginning of the line */
-			win->cur.X = 0;
-			break;
-		case '\n':		/* Newline character */
-			/* Advance the character to the beginning of the line */
-			win->cur.X = 0;
-			/* Advance the cursor to the beginning of a new line */
-			win->cur.Y++;
-			break;
-		default:
-			/* Write the character information to the back buffer with formatting */
-			if (!WriteConsoleOutput(win->hcon[win->bbuf], &c, size, origin, &rect))
-				return ERR;
-			/* Advance the cursor */
-			win->cur.X = (win->cur.X + 1) % win->size.X;
-			/* Check for line wrap */
-			if (!win->cur.X) win->cur.Y++;
+	/* Our parent has one less subwindow (and the lock is still its own) */
+	if (win->parent)
+		win->parent->nsub--;
+	else {
+		DeleteCriticalSection(win->lock);
+		free(win->lock);
 	}
 
+	freecells(win);
+	free(win);
+
 	return OK;
 }
 
 
 /******************************************************************************
  *
- * printw
+ * wresize
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Prints the specified formatted string to 'stdscr'.
+ * DESCRIPTION:    Changes the size of the window pointed to by 'win' to
+ *                 'lines' rows and 'columns' columns, keeping its upper left
+ *                 corner where it is.
  *
- * RETURN VALUE:   Returns OK if the formatted string was successfully written.
- *                 Otherwise, ERR is returned.
+ *                 The cells which the old and new sizes have in common keep
+ *                 their contents, and any new cells are filled with the
+ *                 background character. Only the new cells are marked as
+ *                 changed (along with any which had already changed).
+ *
+ *                 A subwindow simply shows more or less of its parent.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a subwindow would no longer fit in its parent.
+ *
+ * NOTES:          A window which has subwindows cannot be resized, since they
+ *                 point into its cells. Delete them first.
  *
  *****************************************************************************/
 
-int printw(char *fmt, ...)
+int wresize(WINDOW *win, int lines, int columns)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Sanity check: no subwindows point into our cells */
+	if (win->nsub) return ERR;
+
+	/* Sanity check: within bounds? */
+	if (lines <= 0 || columns <= 0 || (win->parent
+			&& (win->org.Y + lines > win->parent->size.Y
+			|| win->org.X + columns > win->parent->size.X)))
+		return ERR;
+
+	return resizewin(win, lines, columns, NULL);
+}
+
+
+/******************************************************************************
+ *
+ * resizeterm
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Changes the size of the screen to 'lines' rows and
+ *                 'columns' columns, along with 'stdscr', 'LINES' and 'COLS'.
+ *
+ *                 The screen is resized in place rather than started over,
+ *                 so whatever is already on the console in the part of it
+ *                 which is left stays there and only the newly exposed part
+ *                 is written by the next update.
+ *
+ *                 This is done by 'wgetch' and 'wc_poll' when the console is
+ *                 resized, before they return KEY_RESIZE or a WC_EVRESIZE
+ *                 event, so programs rarely need to call it themselves.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ * NOTES:          If 'stdscr' has subwindows, it keeps its old size.
+ *                 Other windows are not resized either (see 'wresize'), and
+ *                 whatever part of them is off of the screen is not shown.
+ *
+ *****************************************************************************/
+
+int resizeterm(int lines, int columns)
 {
-	va_list args;
 	int r;
 
-	/* Argument initialization */
-	va_start(args, fmt);
+	/* Make sure nobody else is drawing in stdscr or updating the screen */
+	EnterCriticalSection(stdscr->lock);
+	EnterCriticalSection(&scrlock);
 
-	/* Print our formatted string */
-	r = va_wprintw(stdscr, fmt, &args);
+	r = resizescr(lines, columns);
 
-	/* Argument cleanup */
-	va_end(args);
+	LeaveCriticalSection(&scrlock);
+	LeaveCriticalSection(stdscr->lock);
 
 	return r;
 }
@@ -390,247 +1076,5993 @@ int printw(char *fmt, ...)
 
 /******************************************************************************
  *
- * mvprintw
+ * resizescr
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves to the desired coordinate (y, x) in 'stdscr' and
- *                 and prints the specified formatted string.
+ * DESCRIPTION:    Does the work of 'resizeterm', changing the size of the
+ *                 screen to 'lines' rows and 'columns' columns.
  *
- * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
- *                 Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
  *****************************************************************************/
 
-int mvprintw(int y, int x, char *fmt, ...)
+static int resizescr(int lines, int columns)
 {
-	/* Save our old cursor position in case it needs to be restored later */
-	COORD oldcur = stdscr->cur;
-	va_list args;
-	int r = 0;
+	CHAR_INFO unknown;
+	int oldlines = newscr->size.Y, oldcols = newscr->size.X;
 
-	/* Argument initialization */
-	va_start(args, fmt);
+	/* Sanity check: within bounds? */
+	if (lines <= 0 || columns <= 0 || lines > SHRT_MAX || columns > SHRT_MAX)
+		return ERR;
 
-	/* Move to desired location in the desired window */
-	wmove(stdscr, y, x);
+	/* Nothing to do if the size has not changed */
+	if (lines == newscr->size.Y && columns == newscr->size.X) return OK;
 
-	/* Print our formatted string */
-	r = va_wprintw(stdscr, fmt, &args);
+	/* Curscr and the output backend are the render thread's until it is done */
+	renderwait();
 
-	/* If we were unable to print the string, */
-	if (r == ERR)
-		/* Restore the original cursor location */
-		stdscr->cur = oldcur;
+	/*
+	 * Resize the console first, since it may refuse the new size, in which
+	 * case nothing else has changed yet
+	 */
+	if (output->resize(lines, columns) == ERR) return ERR;
 
-	/* Argument cleanup */
-	va_end(args);
+	/*
+	 * New cells of newscr are blank and get written by the next update.
+	 * Nothing is known about what the console shows in them, though, so make
+	 * sure that they differ in curscr.
+	 */
+	memset(&unknown, 0, sizeof(CHAR_INFO));
+	if (resizewin(newscr, lines, columns, NULL) == ERR
+			|| resizewin(curscr, lines, columns, &unknown) == ERR
+			|| (!stdscr->nsub && resizewin(stdscr, lines, columns, NULL) == ERR)
+			|| !getscratch(sizeof(CHAR_INFO) * lines * columns)) {
+		/*
+		 * Out of memory: put the console and whichever windows were resized
+		 * back the way they were (as far as possible) and redraw everything
+		 */
+		output->resize(oldlines, oldcols);
+		resizewin(newscr, oldlines, oldcols, NULL);
+		resizewin(curscr, oldlines, oldcols, &unknown);
+		if (!stdscr->nsub) resizewin(stdscr, oldlines, oldcols, NULL);
+		curscr->flags |= WC_CLEAROK;
+		return ERR;
+	}
 
-	return r;
+	LINES = lines;
+	COLS = columns;
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * nodelay
+ * newpad
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Sets the 'no delay' mode of the window pointed to by 'win'
- *                 depending on the value of 'bf'.
+ * DESCRIPTION:    Creates a new pad with 'nlines' rows and 'ncols' columns. A
+ *                 pad is a window which is not tied to a place on the screen
+ *                 and may be much larger than it. Any part of a pad can be
+ *                 shown anywhere on the screen with 'prefresh' (or with
+ *                 'pnoutrefresh' and 'doupdate').
  *
- *                 If 'bf' is 'TRUE', 'no delay' mode is turned on and all
- *                 input functions immediately return if there is no input
- *                 present.
+ *                 Memory for the cells of a pad is only allocated for chunks
+ *                 of 'WC_CHUNK' rows as they are first written to, so a pad
+ *                 with millions of rows costs little more than the rows that
+ *                 are actually used (and a few bytes for each of the rest).
  *
- *                 Otherwise, 'no delay' mode is turned off and all input
- *                 functions wait for input before returning.
+ * RETURN VALUE:   Returns a pointer to the new pad. Otherwise, NULL is
+ *                 returned.
  *
- * RETURN VALUE:   Returns OK if 'no delay' mode was set successfully.
- *                 Otherwise, ERR is returned.
+ * NOTES:          Call 'delwin' to free the pad when done with it.
  *
  *****************************************************************************/
 
-int nodelay(WINDOW *win, bool bf)
+WINDOW *newpad(int nlines, int ncols)
 {
-	/* Sanity check: make sure window exists */
-	if (!win) return ERR;
+	/* Sanity check: within bounds? */
+	if (nlines <= 0 || ncols <= 0 || ncols > SHRT_MAX) return NULL;
 
-	/* Set our flag appropriately */
-	if (bf == TRUE)
-		win->flags |= WC_NODELAY;
-	else
-		win->flags &= ~WC_NODELAY;
+	return mkwin(NULL, WC_PAD, nlines, ncols, 0, 0);
+}
 
-	return OK;
+
+/******************************************************************************
+ *
+ * subpad
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Creates a subwindow of the pad pointed to by 'orig' with
+ *                 'nlines' rows and 'ncols' columns whose upper left corner is
+ *                 at ('begin_y', 'begin_x') within 'orig'. The new subwindow
+ *                 is a pad itself.
+ *
+ *                 (See 'derwin' for more information.)
+ *
+ * RETURN VALUE:   Returns a pointer to the new pad. Otherwise, NULL is
+ *                 returned.
+ *
+ *****************************************************************************/
+
+WINDOW *subpad(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x)
+{
+	/* Sanity check: a pad? */
+	if (!orig || !(orig->flags & WC_PAD)) return NULL;
+
+	return derwin(orig, nlines, ncols, begin_y, begin_x);
 }
 
 
 /******************************************************************************
  *
- * mvwprintw
+ * prefresh
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves to the desired coordinate (y, x) in the window pointed
- *                 to by 'win' and prints the specified formatted string.
+ * DESCRIPTION:    Updates the console with part of the pad pointed to by
+ *                 'pad'.
  *
- * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
- *                 Otherwise, ERR is returned.
+ *                 This is the same as calling 'pnoutrefresh' and then
+ *                 'doupdate'.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
  *****************************************************************************/
 
-int mvwprintw(WINDOW *win, int y, int x, char *fmt, ...)
+int prefresh(WINDOW *pad, int pminrow, int pmincol, int sminrow, int smincol,
+		int smaxrow, int smaxcol)
 {
-	/* Save our old cursor position in case it needs to be restored later */
-	COORD oldcur = stdscr->cur;
-	va_list args;
-	int r = 0;
+	if (pnoutrefresh(pad, pminrow, pmincol, sminrow, smincol, smaxrow,
+			smaxcol) == ERR)
+		return ERR;
+	return doupdate();
+}
 
-	/* Sanity check: NULL pointer */
-	if (!win) return ERR;
 
-	/* Argument initialization */
-	va_start(args, fmt);
+/******************************************************************************
+ *
+ * pnoutrefresh
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the part of the pad pointed to by 'pad' whose upper
+ *                 left corner is at ('pminrow', 'pmincol') onto 'newscr', to
+ *                 the region from ('sminrow', 'smincol') to ('smaxrow',
+ *                 'smaxcol') of the screen. The region is shrunk if the pad
+ *                 is too small to fill it.
+ *
+ *                 If the same part of the pad is shown in the same place as
+ *                 last time, only its changed cells are copied. Otherwise, the
+ *                 whole region is copied, a row at a time, and 'doupdate'
+ *                 works out what actually changed on the screen (scrolling it
+ *                 when the pad was scrolled by a few rows).
+ *
+ *                 The rows of the pad which were shown are marked as
+ *                 unchanged.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when 'pad' is not a pad or the region is off the screen.
+ *
+ *****************************************************************************/
 
-	/* Move to desired location in the desired window */
-	wmove(win, y, x);
+int pnoutrefresh(WINDOW *pad, int pminrow, int pmincol, int sminrow,
+		int smincol, int smaxrow, int smaxcol)
+{
+	int rows, cols, y, sy, first, last;
+	bool same;
 
-	/* Print our formatted string */
-	r = va_wprintw(win, fmt, &args);
+	/* Sanity check: a pad? */
+	if (!pad || !(pad->flags & WC_PAD)) return ERR;
 
-	/* If we were unable to print the string, */
-	if (r == ERR)
-		/* Restore the original cursor location */
-		stdscr->cur = oldcur;
+	/* Negative corners mean zero */
+	if (pminrow < 0) pminrow = 0;
+	if (pmincol < 0) pmincol = 0;
+	if (sminrow < 0) sminrow = 0;
+	if (smincol < 0) smincol = 0;
 
-	/* Argument cleanup */
-	va_end(args);
+	/* Sanity check: within bounds? */
+	if (smaxrow >= LINES || smaxcol >= COLS || sminrow > smaxrow
+			|| smincol > smaxcol || pminrow >= pad->size.Y
+			|| pmincol >= pad->size.X)
+		return ERR;
 
-	return r;
+	/* Shrink the region to what the pad can fill */
+	rows = smaxrow - sminrow + 1;
+	cols = smaxcol - smincol + 1;
+	if (rows > pad->size.Y - pminrow) rows = pad->size.Y - pminrow;
+	if (cols > pad->size.X - pmincol) cols = pad->size.X - pmincol;
+
+	/* Make sure nobody else is drawing in the pad or the screen */
+	EnterCriticalSection(pad->lock);
+	EnterCriticalSection(&scrlock);
+	WC_START(WC_PBUILD);
+
+	/* Pass a request to redraw the screen on to 'doupdate' */
+	if (pad->flags & WC_CLEAROK) {
+		curscr->flags |= WC_CLEAROK;
+		pad->flags &= ~WC_CLEAROK;
+	}
+
+	/* See if we are showing the same part of the pad in the same place */
+	same = pad->view.Y == pminrow && pad->view.X == pmincol
+			&& pad->rect.Top == sminrow && pad->rect.Left == smincol
+			&& pad->rect.Bottom == sminrow + rows - 1
+			&& pad->rect.Right == smincol + cols - 1;
+
+	for (y = 0; y < rows; y++) {
+		sy = sminrow + y;
+
+		/* Copy the whole row if the view has changed */
+		if (!same) {
+			first = 0;
+			last = cols - 1;
+		}
+		else {
+			/* Otherwise, only copy the part of the row which has changed */
+			if (pad->firstch[pminrow + y] == WC_NOCHANGE) continue;
+			first = pad->firstch[pminrow + y] - pmincol;
+			last = pad->lastch[pminrow + y] - pmincol;
+			if (first < 0) first = 0;
+			if (last > cols - 1) last = cols - 1;
+		}
+
+		if (first <= last) {
+			markdirty(newscr, sy, smincol + first, smincol + last);
+			memcpy(&newscr->line[sy][smincol + first],
+					&pad->line[pminrow + y][pmincol + first],
+					sizeof(CHAR_INFO) * (last - first + 1));
+		}
+
+		pad->firstch[pminrow + y] = pad->lastch[pminrow + y] = WC_NOCHANGE;
+	}
+
+	/* Remember what we showed and where */
+	pad->view.Y = pminrow;
+	pad->view.X = pmincol;
+	pad->rect.Top = sminrow;
+	pad->rect.Left = smincol;
+	pad->rect.Bottom = sminrow + rows - 1;
+	pad->rect.Right = smincol + cols - 1;
+
+	/* Put the screen's cursor where the pad's is, if it was shown */
+	if (pad->cur.Y >= pminrow && pad->cur.Y < pminrow + rows
+			&& pad->cur.X >= pmincol && pad->cur.X < pmincol + cols) {
+		newscr->cur.Y = sminrow + pad->cur.Y - pminrow;
+		newscr->cur.X = smincol + pad->cur.X - pmincol;
+	}
+
+	WC_STOP(WC_PBUILD);
+	LeaveCriticalSection(&scrlock);
+	LeaveCriticalSection(pad->lock);
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * wprintw
+ * wc_backend
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Prints the specified formatted string in the window pointed
- *                 to by 'win'.
+ * DESCRIPTION:    Selects the output backend 'b' to be set up by the next call
+ *                 to 'initscr'.
  *
- * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
- *                 Otherwise, ERR is returned.
+ *                 WC_CONSOLE (the default) writes cells with the Win32 console
+ *                 API, using a pair of console buffers.
+ *
+ *                 WC_VT writes virtual terminal (ANSI) escape sequences to
+ *                 the original console, batching each refresh into a single
+ *                 write. This is much faster under Windows Terminal and over
+ *                 remote connections. If the console does not support virtual
+ *                 terminal sequences, 'initscr' falls back on WC_CONSOLE.
+ *
+ *                 WC_MEMORY draws into a screen in memory instead of the
+ *                 console, and reads input records queued with 'wc_meminput'
+ *                 instead of the console's input. No console is needed at
+ *                 all, which makes it useful for measuring the library's own
+ *                 cost, running programs without a console, and checking what
+ *                 they draw (see 'wc_memframe').
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when 'b' is not a known backend.
+ *
+ * NOTES:          This function must be called before 'initscr'.
  *
  *****************************************************************************/
 
-int wprintw(WINDOW *win, char *fmt, ...)
+int wc_backend(int b)
 {
-	va_list args;
-	int r;
-
-	/* Sanity check: NULL pointer */
-	if (!win) return ERR;
-
-	/* Argument initialization */
-	va_start(args, fmt);
-
-	/* Print our formatted string */
-	r = va_wprintw(win, fmt, &args);
+	/* Sanity check: known backend? */
+	if (b != WC_CONSOLE && b != WC_VT && b != WC_MEMORY) return ERR;
 
-	/* Argument cleanup */
-	va_end(args);
+	backend = b;
 
-	return r;
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * attron
+ * wc_singlebuf
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables the attributes specified by the 'attrs' bit map in
- *                 'stdscr'.
+ * DESCRIPTION:    If 'bf' is 'TRUE', the next call to 'initscr' creates a
+ *                 single console buffer which 'refresh' writes to directly.
+ *                 (This only affects the WC_CONSOLE backend.)
+ *
+ *                 If 'bf' is 'FALSE' (the default), 'initscr' creates a
+ *                 primary and a back buffer which 'refresh' swaps between.
+ *
+ *                 Single buffer mode halves the number of console writes made
+ *                 by 'refresh' at the cost of updates appearing as they are
+ *                 written instead of all at once.
  *
  * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
  *
- * NOTES:          This function always succeeds.
+ * NOTES:          This function must be called before 'initscr'.
  *
  *****************************************************************************/
 
-int attron(int attrs)
+int wc_singlebuf(bool bf)
 {
-	return wattron(stdscr, attrs);
+	/* Set our flag appropriately */
+	if (bf == TRUE)
+		flags |= WC_SINGLEBUF;
+	else
+		flags &= ~WC_SINGLEBUF;
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * attroff
+ * wc_spangap
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Disables the attributes specified by the 'attrs' bit map in
- *                 'stdscr'.
+ * DESCRIPTION:    Sets the largest number of unchanged cells, 'n', which
+ *                 'refresh' will rewrite in order to join two runs of changed
+ *                 cells on the same row into a single span.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *                 Each span costs one console call, so larger values trade
+ *                 rewriting more cells for making fewer calls. Zero only ever
+ *                 writes changed cells. 'initscr' sets the default of
+ *                 'WC_SPANGAP' for the WC_CONSOLE backend and zero for the
+ *                 WC_VT backend, which has its own way of skipping gaps.
  *
- * NOTES:          This function always succeeds.
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when 'n' is negative.
+ *
+ *****************************************************************************/
+
+int wc_spangap(int n)
+{
+	/* Sanity check: within range? */
+	if (n < 0) return ERR;
+
+	spangap = n;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_framerate
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Limits how often the console is written to, so that frames
+ *                 are at least 'ms' milliseconds apart, or removes the limit
+ *                 if 'ms' is zero (the default).
+ *
+ *                 With a limit, a refresh which comes too soon after the last
+ *                 frame only marks the screen as stale. Changes made until the
+ *                 next frame are merged and written together, either by a
+ *                 later refresh, by 'wgetch' or 'wc_poll' waking up once the
+ *                 limit has passed, or by calling 'wc_flush'. This caps the
+ *                 cost of writing to the console however often a program
+ *                 refreshes.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when 'ms' is negative or a stale screen could not be written
+ *                 when removing the limit.
+ *
+ *****************************************************************************/
+
+int wc_framerate(int ms)
+{
+	/* Sanity check: within range? */
+	if (ms < 0) return ERR;
+
+	framems = ms;
+
+	/* Without a limit, nothing may be held back */
+	if (!ms && framestale) return wc_flush();
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_render
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Starts a render thread which writes frames to the console in
+ *                 the background if 'bf' is 'TRUE', or stops it (after it has
+ *                 written every frame it was given) if 'bf' is 'FALSE' (the
+ *                 default).
+ *
+ *                 With a render thread, 'doupdate' only copies 'newscr' into
+ *                 a frame and hands it over with an atomic pointer swap, so a
+ *                 slow console doesn't hold the program up. Frames handed
+ *                 over while the render thread is still busy replace the
+ *                 last one handed over, so it always draws the latest.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the thread or its frames could not be created.
+ *
+ * NOTES:          This function must be called after 'initscr'. 'endwin'
+ *                 stops the render thread.
+ *
+ *                 The render thread doesn't change which functions may be
+ *                 called from which thread (see 'THREADS' in wincurses.h).
+ *                 Functions which need 'curscr' or the output backend wait
+ *                 for it to draw every frame handed to it first: 'curs_set',
+ *                 'wc_memframe', and 'resizeterm' (or any other change in
+ *                 the screen's size, such as one 'wgetch' or 'wc_poll'
+ *                 reads).
+ *
+ *****************************************************************************/
+
+int wc_render(bool bf)
+{
+	/* Nothing to do if the render thread is already started (or stopped) */
+	if (!bf == !rthread) return OK;
+
+	if (bf) {
+		/* Sanity check: after 'initscr'? */
+		if (!newscr) return ERR;
+
+		/* Make the frames to hand over and the events to wake up on */
+		rback = mkframe();
+		rmid = mkframe();
+		rfront = mkframe();
+		rwake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		ridle = CreateEvent(NULL, FALSE, FALSE, NULL);
+		rstop = FALSE;
+		rasked = rdone = 0;
+
+		/* Start the render thread */
+		if (rback && rmid && rfront && rwake && ridle)
+			rthread = CreateThread(NULL, 0, renderloop, NULL, 0, NULL);
+	} else {
+		/* Let the render thread finish drawing, and wait for it to end */
+		rstop = TRUE;
+		SetEvent(rwake);
+		WaitForSingleObject(rthread, INFINITE);
+		CloseHandle(rthread);
+		rthread = NULL;
+	}
+
+	/* Clean up after a thread which has ended (or failed to start) */
+	if (!rthread) {
+		freeframe(rback);
+		freeframe(rmid);
+		freeframe(rfront);
+		rback = rmid = rfront = NULL;
+		if (rwake) CloseHandle(rwake);
+		if (ridle) CloseHandle(ridle);
+		rwake = ridle = NULL;
+	}
+
+	return !bf == !rthread ? OK : ERR;
+}
+
+
+/******************************************************************************
+ *
+ * wc_lock
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Locks the window pointed to by 'win' (along with every
+ *                 window sharing its cells), waiting for any other thread
+ *                 which holds the lock to let go of it first.
+ *
+ *                 A thread drawing in a window which another thread refreshes
+ *                 should hold the lock while it draws each frame, so that
+ *                 'wnoutrefresh' and 'pnoutrefresh' (which take the lock
+ *                 themselves) never copy a frame which is half drawn. (See
+ *                 'THREADS'.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          A thread may lock a window more than once, and must unlock
+ *                 it (see 'wc_unlock') as many times.
+ *
+ *****************************************************************************/
+
+int wc_lock(WINDOW *win)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	EnterCriticalSection(win->lock);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_unlock
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Unlocks the window pointed to by 'win', which was locked by
+ *                 'wc_lock'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wc_unlock(WINDOW *win)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	LeaveCriticalSection(win->lock);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_stats
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies what updates have cost since the last call (or since
+ *                 the program started) into the structure pointed to by 's',
+ *                 and starts counting again from zero. Calling it after each
+ *                 refresh gives the cost of that refresh.
+ *
+ *                 Counting is only compiled in when WC_STATS is defined, so
+ *                 that it costs nothing otherwise.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when counting was not compiled in (and 's' is zeroed).
+ *
+ * NOTES:          With a render thread (see 'wc_render'), a frame which is
+ *                 still being drawn may be counted in part.
+ *
+ *****************************************************************************/
+
+int wc_stats(wcstats_t *s)
+{
+#ifdef WC_STATS
+	LARGE_INTEGER freq;
+#endif
+
+	/* Sanity check: NULL pointer */
+	if (!s) return ERR;
+
+#ifdef WC_STATS
+	*s = stats;
+
+	/* Turn performance counter ticks into microseconds */
+	QueryPerformanceFrequency(&freq);
+	s->build = phaseticks[WC_PBUILD] * 1000000 / freq.QuadPart;
+	s->diff = phaseticks[WC_PDIFF] * 1000000 / freq.QuadPart;
+	s->flush = phaseticks[WC_PFLUSH] * 1000000 / freq.QuadPart;
+
+	/* Start again */
+	memset(&stats, 0, sizeof(wcstats_t));
+	memset(phaseticks, 0, sizeof(phaseticks));
+
+	return OK;
+#else
+	memset(s, 0, sizeof(wcstats_t));
+
+	return ERR;
+#endif
+}
+
+/******************************************************************************
+ *
+ * wc_memframe
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies what the memory backend's screen shows (see
+ *                 'wc_backend') into the array pointed to by 'cells', row
+ *                 after row, and the position of its cursor into 'cur'.
+ *                 Either may be NULL.
+ *
+ *                 This is what the console would show: cells which have not
+ *                 been refreshed yet, or which are being held back by the
+ *                 frame rate limit (see 'wc_framerate'), are not included.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the memory backend is not in use.
+ *
+ * NOTES:          'cells' must have room for 'LINES' times 'COLS' cells.
+ *
+ *****************************************************************************/
+
+int wc_memframe(CHAR_INFO *cells, COORD *cur)
+{
+	/* Sanity check: using the memory backend? */
+	if (output != &memoutput) return ERR;
+
+	/* Another thread may be updating the screen */
+	EnterCriticalSection(&scrlock);
+
+	/* Let the render thread finish drawing first */
+	renderwait();
+
+	if (cells)
+		memcpy(cells, memcells,
+				sizeof(CHAR_INFO) * memsize.Y * memsize.X);
+	if (cur) *cur = memcur;
+
+	LeaveCriticalSection(&scrlock);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_meminput
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the 'n' input records in the array pointed to by
+ *                 'recs' for the memory backend (see 'wc_backend') to read
+ *                 as though they came from the console, after any records
+ *                 which are already queued.
+ *
+ *                 Records of any kind may be queued: key presses and
+ *                 releases, mouse events, focus events and changes in size
+ *                 (which resize the screen as they are read, see
+ *                 'checksize').
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the memory backend is not in use.
+ *
+ * NOTES:          Once every queued record has been read, input functions
+ *                 which would wait forever return ERR (or no events) instead,
+ *                 since nothing else can arrive. Input functions with a delay
+ *                 still wait for it to run out.
+ *
+ *                 Records may be queued from any thread, since the queue is
+ *                 only changed while holding 'scrlock'.
+ *
+ *****************************************************************************/
+
+int wc_meminput(const INPUT_RECORD *recs, int n)
+{
+	INPUT_RECORD *p;
+	size_t size;
+
+	/* Sanity check: using the memory backend, and something to queue? */
+	if (output != &memoutput || !recs || n < 0) return ERR;
+
+	/* Another thread may be reading from the queue */
+	EnterCriticalSection(&scrlock);
+
+	/* Move the records still queued to the front */
+	if (memhead) {
+		memmove(memin, memin + memhead, sizeof(INPUT_RECORD) * meminlen);
+		memhead = 0;
+	}
+
+	/* Grow the queue, doubling its size to keep reallocations rare */
+	if (meminlen + n > meminsize) {
+		size = meminsize ? meminsize : WC_INPUTBATCH;
+		while (size < meminlen + n) size *= 2;
+		p = realloc(memin, sizeof(INPUT_RECORD) * size);
+		if (!p) {
+			LeaveCriticalSection(&scrlock);
+			return ERR;
+		}
+		memin = p;
+		meminsize = size;
+	}
+
+	memcpy(memin + meminlen, recs, sizeof(INPUT_RECORD) * n);
+	meminlen += n;
+
+	/* Signal the input handle, like the console does when input arrives */
+	if (meminlen) SetEvent(hstdin);
+
+	LeaveCriticalSection(&scrlock);
+
+	return OK;
+}
+
+
+
+/******************************************************************************
+ *
+ * addch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the character 'ch' to 'stdscr' starting at the current
+ *                 cursor location and increments the cursor location when done
+ *                 to the location immediately following the written character.
+ *
+ *                 The cursor is advanced to the beginning of the next line if,
+ *                 after writing the character, the cursor would run past the
+ *                 end of a row in the console buffer. If scrolling has been
+ *                 enabled with 'scrollok' and the cursor is on the bottom row
+ *                 of the scrolling region, the region scrolls up a row and the
+ *                 cursor stays on that row instead.
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int addch(const chtype ch)
+{
+	return waddch(stdscr, ch);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x'), adds a
+ *                 character at that position, and increments the cursor
+ *                 location when done to the location immediately following the
+ *                 written character.
+ *
+ *                 (See 'addch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddch(int y, int x, const chtype ch)
+{
+	return mvwaddch(stdscr, y, x, ch);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x'), adds a
+ *                 character at that position, and increments the cursor
+ *                 location when done to the location immediately following the
+ *                 written character.
+ *
+ *                 (See 'addch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddch(WINDOW *win, int y, int x, const chtype ch)
+{
+	if (wmove(win, y, x) == ERR)
+		return ERR;
+	return waddch(win, ch);
+}
+
+
+/******************************************************************************
+ *
+ * waddch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the character 'ch' to 'win' starting at the current
+ *                 cursor location and increments the cursor location when done
+ *                 to the location immediately following the written character.
+ *
+ *                 Any attributes and color pair carried by 'ch' are applied
+ *                 along with the window's (see 'cellattrs'). Characters above
+ *                 0x7f are taken to be Latin-1; use 'wadd_wch' for others.
+ *
+ *                 (See 'addch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ * NOTES:          Handle 'special' characters (backspace, etc.)
+ *
+ *****************************************************************************/
+
+int waddch(WINDOW *win, const chtype ch)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* TODO: Handle special characters */
+	/* Check for a special character */
+	switch (ch & A_CHARTEXT) {
+		case '\r':		/* Carriage return */
+			/* Advance the character to the beginning of the line */
+			win->cur.X = 0;
+			break;
+		case '\n':		/* Newline character */
+			/* Advance the character to the beginning of the line */
+			win->cur.X = 0;
+			/* Advance the cursor to the beginning of a new line */
+			if (newline(win) == ERR) return ERR;
+			break;
+		default:
+			/* Write the character with formatting and advance the cursor */
+			return putcell(win, (WCHAR)(ch & A_CHARTEXT), cellattrs(win, ch));
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * addstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the string 'str' to 'stdscr' starting at the current
+ *                 cursor location.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int addstr(const char *str)
+{
+	return waddnstr(stdscr, str, -1);
+}
+
+
+/******************************************************************************
+ *
+ * addnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds at most 'n' characters of the string 'str' to 'stdscr'
+ *                 starting at the current cursor location.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int addnstr(const char *str, int n)
+{
+	return waddnstr(stdscr, str, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and adds
+ *                 the string 'str' at that position.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddstr(int y, int x, const char *str)
+{
+	return mvwaddnstr(stdscr, y, x, str, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and adds
+ *                 at most 'n' characters of the string 'str' at that position.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddnstr(int y, int x, const char *str, int n)
+{
+	return mvwaddnstr(stdscr, y, x, str, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and adds the
+ *                 string 'str' at that position.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddstr(WINDOW *win, int y, int x, const char *str)
+{
+	return mvwaddnstr(win, y, x, str, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and adds at
+ *                 most 'n' characters of the string 'str' at that position.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddnstr(WINDOW *win, int y, int x, const char *str, int n)
+{
+	if (wmove(win, y, x) == ERR)
+		return ERR;
+	return waddnstr(win, str, n);
+}
+
+
+/******************************************************************************
+ *
+ * waddstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the string 'str' to 'win' starting at the current
+ *                 cursor location.
+ *
+ *                 (See 'waddnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddstr(WINDOW *win, const char *str)
+{
+	return waddnstr(win, str, -1);
+}
+
+
+/******************************************************************************
+ *
+ * waddnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds at most 'n' bytes of the string 'str' to 'win'
+ *                 starting at the current cursor location, or the whole string
+ *                 if 'n' is negative. The cursor is left immediately following
+ *                 the last character written.
+ *
+ *                 The string is decoded as UTF-8 (see 'putstr'), and 'n'
+ *                 counts bytes rather than characters. The result is the same
+ *                 as calling 'wadd_wch' for each character.
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddnstr(WINDOW *win, const char *str, int n)
+{
+	return putstr(win, str, n, NULL);
+}
+
+
+/******************************************************************************
+ *
+ * addchstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the character string 'chstr' to 'stdscr' starting at
+ *                 the current cursor location.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int addchstr(const chtype *chstr)
+{
+	return waddchnstr(stdscr, chstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * addchnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies at most 'n' characters of the character string
+ *                 'chstr' to 'stdscr' starting at the current cursor location.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int addchnstr(const chtype *chstr, int n)
+{
+	return waddchnstr(stdscr, chstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddchstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and
+ *                 copies the character string 'chstr' to that position.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddchstr(int y, int x, const chtype *chstr)
+{
+	return mvwaddchnstr(stdscr, y, x, chstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddchnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and
+ *                 copies at most 'n' characters of the character string
+ *                 'chstr' to that position.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddchnstr(int y, int x, const chtype *chstr, int n)
+{
+	return mvwaddchnstr(stdscr, y, x, chstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddchstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and copies
+ *                 the character string 'chstr' to that position.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddchstr(WINDOW *win, int y, int x, const chtype *chstr)
+{
+	return mvwaddchnstr(win, y, x, chstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddchnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and copies
+ *                 at most 'n' characters of the character string 'chstr' to
+ *                 that position.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddchnstr(WINDOW *win, int y, int x, const chtype *chstr, int n)
+{
+	if (wmove(win, y, x) == ERR)
+		return ERR;
+	return waddchnstr(win, chstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * waddchstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the character string 'chstr' to 'win' starting at the
+ *                 current cursor location.
+ *
+ *                 (See 'waddchnstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddchstr(WINDOW *win, const chtype *chstr)
+{
+	return waddchnstr(win, chstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * waddchnstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies at most 'n' characters of the character string
+ *                 'chstr' to 'win' starting at the current cursor location, or
+ *                 the whole string if 'n' is negative.
+ *
+ *                 Unlike 'waddnstr', the string is copied as-is: special
+ *                 characters are not interpreted, the string is truncated at
+ *                 the end of the row instead of wrapping, and the cursor is
+ *                 not moved.
+ *
+ *                 Each character is written with the attributes and color
+ *                 pair it carries (see 'cellattrs'), so a whole row of
+ *                 differently colored cells can be written at once.
+ *
+ * RETURN VALUE:   Returns OK if the string was successfully written. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddchnstr(WINDOW *win, const chtype *chstr, int n)
+{
+	CHAR_INFO *c;
+	chtype attrs;
+	WORD a;
+	int len, i;
+
+	/* Sanity check: NULL pointers */
+	if (!win || !chstr) return ERR;
+
+	/* Sanity check: the cursor has not run off the bottom */
+	if (win->cur.Y >= win->size.Y) return ERR;
+
+	/* Find how much of the string fits on the rest of the row */
+	for (len = 0; (n < 0 || len < n) && len < win->size.X - win->cur.X; len++)
+		if (!chstr[len]) break;
+
+	/* Nothing to do for an empty string */
+	if (!len) return OK;
+
+	/* Write the string to our cells with formatting */
+	if (markdirty(win, win->cur.Y, win->cur.X, win->cur.X + len - 1) == ERR)
+		return ERR;
+	c = &win->line[win->cur.Y][win->cur.X];
+	attrs = A_NORMAL;
+	a = win->attrs;
+	for (i = 0; i < len; i++) {
+		/* Only translate attributes when they change from the last cell */
+		if ((chstr[i] & A_ATTRIBUTES) != attrs) {
+			attrs = chstr[i] & A_ATTRIBUTES;
+			a = cellattrs(win, attrs);
+		}
+		c[i].Char.UnicodeChar = (WCHAR)(chstr[i] & A_CHARTEXT);
+		c[i].Attributes = a;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * setcchar
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the wide character pointed to by 'wcval' to the string
+ *                 of wide characters 'wch', with the attributes 'attrs' and the
+ *                 color pair 'color_pair'. 'opts' is reserved and must be NULL.
+ *
+ *                 Only the first 'CCHARW_MAX' - 1 characters of 'wch' are
+ *                 kept.
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully set. Otherwise,
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int setcchar(cchar_t *wcval, const wchar_t *wch, const attr_t attrs,
+		short color_pair, const void *opts)
+{
+	int i;
+
+	/* Sanity check: NULL pointers and reserved options */
+	if (!wcval || !wch || opts) return ERR;
+
+	/* Sanity check: the color pair exists */
+	if (color_pair < 0 || color_pair >= MAX_NUM_PAIRS) return ERR;
+
+	/* Combine the attributes and color pair */
+	wcval->attr = ((chtype)attrs & A_ATTRIBUTES & ~A_COLOR)
+			| COLOR_PAIR(color_pair);
+
+	/* Copy the characters, keeping room for the terminator */
+	for (i = 0; i < CCHARW_MAX - 1 && wch[i]; i++)
+		wcval->chars[i] = wch[i];
+	wcval->chars[i] = L'\0';
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * add_wch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the wide character 'wch' to 'stdscr' starting at the
+ *                 current cursor location.
+ *
+ *                 (See 'wadd_wch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int add_wch(const cchar_t *wch)
+{
+	return wadd_wch(stdscr, wch);
+}
+
+
+/******************************************************************************
+ *
+ * mvadd_wch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and adds
+ *                 the wide character 'wch' at that position.
+ *
+ *                 (See 'wadd_wch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvadd_wch(int y, int x, const cchar_t *wch)
+{
+	return mvwadd_wch(stdscr, y, x, wch);
+}
+
+
+/******************************************************************************
+ *
+ * mvwadd_wch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and adds
+ *                 the wide character 'wch' at that position.
+ *
+ *                 (See 'wadd_wch' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwadd_wch(WINDOW *win, int y, int x, const cchar_t *wch)
+{
+	if (wmove(win, y, x) == ERR)
+		return ERR;
+	return wadd_wch(win, wch);
+}
+
+
+/******************************************************************************
+ *
+ * wadd_wch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the wide character 'wch' to 'win' starting at the
+ *                 current cursor location and increments the cursor location
+ *                 when done, just as 'waddch' does. Its attributes and color
+ *                 pair are applied along with the window's (see 'cellattrs').
+ *
+ *                 Only the first character of 'wch' is written, since console
+ *                 cells cannot combine characters. Characters which do not fit
+ *                 in a cell are written as 'WC_BADCHAR'.
+ *
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wadd_wch(WINDOW *win, const cchar_t *wch)
+{
+	wchar_t wc;
+
+	/* Sanity check: NULL pointers */
+	if (!win || !wch) return ERR;
+
+	wc = wch->chars[0];
+
+	/* Leave special characters to waddch */
+	if (wc == L'\r' || wc == L'\n')
+		return waddch(win, (chtype)wc | (wch->attr & A_ATTRIBUTES));
+
+	/* Surrogates and characters beyond a cell cannot be stored */
+	if ((unsigned long)wc > 0xffff || (wc >= 0xd800 && wc < 0xe000))
+		wc = WC_BADCHAR;
+
+	/* Write the character with formatting and advance the cursor */
+	return putcell(win, (WCHAR)wc, cellattrs(win, wch->attr));
+}
+
+
+/******************************************************************************
+ *
+ * addwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the wide character string 'wstr' to 'stdscr' starting
+ *                 at the current cursor location.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int addwstr(const wchar_t *wstr)
+{
+	return waddnwstr(stdscr, wstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * addnwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds at most 'n' characters of the wide character string
+ *                 'wstr' to 'stdscr' starting at the current cursor location.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int addnwstr(const wchar_t *wstr, int n)
+{
+	return waddnwstr(stdscr, wstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and adds
+ *                 the wide character string 'wstr' at that position.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddwstr(int y, int x, const wchar_t *wstr)
+{
+	return mvwaddnwstr(stdscr, y, x, wstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvaddnwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and adds
+ *                 at most 'n' characters of the wide character string 'wstr'
+ *                 at that position.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvaddnwstr(int y, int x, const wchar_t *wstr, int n)
+{
+	return mvwaddnwstr(stdscr, y, x, wstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and adds
+ *                 the wide character string 'wstr' at that position.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddwstr(WINDOW *win, int y, int x, const wchar_t *wstr)
+{
+	return mvwaddnwstr(win, y, x, wstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * mvwaddnwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x') and adds at
+ *                 most 'n' characters of the wide character string 'wstr' at
+ *                 that position.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwaddnwstr(WINDOW *win, int y, int x, const wchar_t *wstr, int n)
+{
+	if (wmove(win, y, x) == ERR)
+		return ERR;
+	return waddnwstr(win, wstr, n);
+}
+
+
+/******************************************************************************
+ *
+ * waddwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the wide character string 'wstr' to 'win' starting at
+ *                 the current cursor location.
+ *
+ *                 (See 'waddnwstr' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddwstr(WINDOW *win, const wchar_t *wstr)
+{
+	return waddnwstr(win, wstr, -1);
+}
+
+
+/******************************************************************************
+ *
+ * waddnwstr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds at most 'n' characters of the wide character string
+ *                 'wstr' to 'win' starting at the current cursor location, or
+ *                 the whole string if 'n' is negative, with the window's
+ *                 attributes. The cursor is left immediately following the
+ *                 last character written.
+ *
+ *                 The result is the same as calling 'wadd_wch' for each
+ *                 character.
+ *
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int waddnwstr(WINDOW *win, const wchar_t *wstr, int n)
+{
+	wchar_t wc;
+	int i;
+
+	/* Sanity check: NULL pointers */
+	if (!win || !wstr) return ERR;
+
+	for (i = 0; (n < 0 || i < n) && wstr[i]; i++) {
+		wc = wstr[i];
+
+		/* Leave special characters to waddch */
+		if (wc == L'\r' || wc == L'\n') {
+			if (waddch(win, (chtype)wc) == ERR) return ERR;
+			continue;
+		}
+
+		/* Surrogates and characters beyond a cell cannot be stored */
+		if ((unsigned long)wc > 0xffff || (wc >= 0xd800 && wc < 0xe000))
+			wc = WC_BADCHAR;
+
+		/* Write the character and advance the cursor */
+		if (putcell(win, (WCHAR)wc, win->attrs) == ERR) return ERR;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * erase
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears 'stdscr'.
+ *
+ *                 (See 'werase' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int erase(void)
+{
+	return werase(stdscr);
+}
+
+
+/******************************************************************************
+ *
+ * werase
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Fills every cell of the window pointed to by 'win' with its
+ *                 background (see 'bkgdcell') and moves the cursor to the upper
+ *                 left corner.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a pad's rows could not be given cells of their own.
+ *
+ * NOTES:          Each row is filled in one go and marked as changed once (see
+ *                 'fillcells'), so clearing costs about as much as copying the
+ *                 window.
+ *
+ *****************************************************************************/
+
+int werase(WINDOW *win)
+{
+	CHAR_INFO fill;
+	int y;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Fill every row with the background */
+	fill = bkgdcell(win);
+	for (y = 0; y < win->size.Y; y++)
+		if (fillcells(win, y, 0, win->size.X - 1, fill) == ERR) return ERR;
+
+	/* Move the cursor home */
+	win->cur.Y = win->cur.X = 0;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * clear
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears 'stdscr' and redraws the whole screen on the next
+ *                 refresh.
+ *
+ *                 (See 'wclear' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int clear(void)
+{
+	return wclear(stdscr);
+}
+
+
+/******************************************************************************
+ *
+ * wclear
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears the window pointed to by 'win', just like 'werase',
+ *                 and has the next refresh of the window redraw the whole
+ *                 screen (see 'clearok').
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wclear(WINDOW *win)
+{
+	if (werase(win) == ERR) return ERR;
+	return clearok(win, TRUE);
+}
+
+
+/******************************************************************************
+ *
+ * clearok
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets whether the next refresh of the window pointed to by
+ *                 'win' redraws the whole screen from scratch, instead of only
+ *                 writing the cells which have changed, according to 'bf'.
+ *                 This puts right a screen which was written to by something
+ *                 else. (Passing 'curscr' redraws on the next 'doupdate'.)
+ *
+ * RETURN VALUE:   Returns OK if the setting was changed. Otherwise, ERR is
+ *                 returned.
+ *
+ *****************************************************************************/
+
+int clearok(WINDOW *win, bool bf)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	if (bf == TRUE)
+		win->flags |= WC_CLEAROK;
+	else
+		win->flags &= ~WC_CLEAROK;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * clrtoeol
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears 'stdscr' from the cursor to the end of its row.
+ *
+ *                 (See 'wclrtoeol' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int clrtoeol(void)
+{
+	return wclrtoeol(stdscr);
+}
+
+
+/******************************************************************************
+ *
+ * wclrtoeol
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Fills the cells of the window pointed to by 'win' from the
+ *                 cursor to the end of its row with the window's background
+ *                 (see 'bkgdcell'). The cursor does not move.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wclrtoeol(WINDOW *win)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Sanity check: the cursor has not run off the bottom */
+	if (win->cur.Y >= win->size.Y) return ERR;
+
+	return fillcells(win, win->cur.Y, win->cur.X, win->size.X - 1,
+			bkgdcell(win));
+}
+
+
+/******************************************************************************
+ *
+ * clrtobot
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears 'stdscr' from the cursor to the bottom.
+ *
+ *                 (See 'wclrtobot' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int clrtobot(void)
+{
+	return wclrtobot(stdscr);
+}
+
+
+/******************************************************************************
+ *
+ * wclrtobot
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Fills the cells of the window pointed to by 'win' from the
+ *                 cursor to the end of its row, and every row below it, with
+ *                 the window's background (see 'bkgdcell'). The cursor does
+ *                 not move.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wclrtobot(WINDOW *win)
+{
+	CHAR_INFO fill;
+	int y;
+
+	/* Clear the rest of the cursor's row */
+	if (wclrtoeol(win) == ERR) return ERR;
+
+	/* Then every row below it */
+	fill = bkgdcell(win);
+	for (y = win->cur.Y + 1; y < win->size.Y; y++)
+		if (fillcells(win, y, 0, win->size.X - 1, fill) == ERR) return ERR;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * bkgd
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the background of 'stdscr' and applies it to every
+ *                 cell.
+ *
+ *                 (See 'wbkgd' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int bkgd(chtype ch)
+{
+	return wbkgd(stdscr, ch);
+}
+
+
+/******************************************************************************
+ *
+ * wbkgd
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the background of the window pointed to by 'win' to
+ *                 'ch' (see 'wbkgdset') and applies it to every cell: cells
+ *                 showing the old background character show the new one, and
+ *                 cells with the old background's attributes take the new
+ *                 background's attributes.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          The background only fills cells which are cleared or
+ *                 scrolled in. Unlike in other curses implementations, its
+ *                 attributes are not combined with characters written later
+ *                 on; use 'wattrset' for those.
+ *
+ *****************************************************************************/
+
+int wbkgd(WINDOW *win, chtype ch)
+{
+	CHAR_INFO old, fill, blank, *c;
+	bool blanked = FALSE;
+	int y, x, first, last;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Switch backgrounds */
+	old = bkgdcell(win);
+	win->bkgd = ch;
+	fill = bkgdcell(win);
+
+	/* Nothing to do if the cells would be filled the same way */
+	if (SAMECELL(old, fill)) return OK;
+
+	/*
+	 * The rows of a pad which were never written to all show its blank chunk
+	 * (see 'ownrow'), whose cells are all the same, so rewrite that once
+	 * instead of giving each of them cells of their own
+	 */
+	if (win->chunks) {
+		blank = win->blank[0];
+		if (blank.Char.UnicodeChar == old.Char.UnicodeChar)
+			blank.Char.UnicodeChar = fill.Char.UnicodeChar;
+		if (blank.Attributes == old.Attributes)
+			blank.Attributes = fill.Attributes;
+		blanked = !SAMECELL(blank, win->blank[0]);
+		for (x = 0; blanked && x < WC_CHUNK * win->size.X; x++)
+			win->blank[x] = blank;
+	}
+
+	for (y = 0; y < win->size.Y; y++) {
+		/*
+		 * Mark the rows of the blank chunk as changed by hand, since
+		 * 'markdirty' would give them cells of their own. (A pad has no
+		 * parent to pass the change on to.)
+		 */
+		if (win->chunks && !win->chunks[y / WC_CHUNK]) {
+			if (blanked) {
+				win->firstch[y] = 0;
+				win->lastch[y] = win->size.X - 1;
+				win->hashok[y] = FALSE;
+			}
+			continue;
+		}
+
+		/* Replace the old background in each cell which shows it */
+		c = win->line[y];
+		first = last = -1;
+		for (x = 0; x < win->size.X; x++) {
+			if (c[x].Char.UnicodeChar != old.Char.UnicodeChar
+					&& c[x].Attributes != old.Attributes)
+				continue;
+			if (first < 0) first = x;
+			last = x;
+			if (c[x].Char.UnicodeChar == old.Char.UnicodeChar)
+				c[x].Char.UnicodeChar = fill.Char.UnicodeChar;
+			if (c[x].Attributes == old.Attributes)
+				c[x].Attributes = fill.Attributes;
+		}
+
+		/* Mark the cells changed once for the whole row */
+		if (first >= 0 && markdirty(win, y, first, last) == ERR) return ERR;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * bkgdset
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the background of 'stdscr' without changing any cells.
+ *
+ *                 (See 'wbkgdset' for more information.)
+ *
+ *****************************************************************************/
+
+void bkgdset(chtype ch)
+{
+	wbkgdset(stdscr, ch);
+}
+
+
+/******************************************************************************
+ *
+ * wbkgdset
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the background of the window pointed to by 'win' to
+ *                 'ch', without changing any cells. The character of 'ch' (or
+ *                 'WC_BGND' if it has none) and its attributes and color pair
+ *                 fill the cells which are cleared or scrolled in from now on.
+ *
+ *                 If 'ch' carries no attributes, the window's attributes at the
+ *                 time are used instead (see 'cellattrs').
+ *
+ *****************************************************************************/
+
+void wbkgdset(WINDOW *win, chtype ch)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return;
+
+	win->bkgd = ch;
+}
+
+
+/******************************************************************************
+ *
+ * getbkgd
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Gets the background of the window pointed to by 'win'.
+ *
+ * RETURN VALUE:   Returns the background set by 'wbkgd' or 'wbkgdset'.
+ *
+ *****************************************************************************/
+
+chtype getbkgd(WINDOW *win)
+{
+	return win ? win->bkgd : A_NORMAL;
+}
+
+
+/******************************************************************************
+ *
+ * copywin
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the cells of the window pointed to by 'srcwin'
+ *                 starting at ('sminrow', 'smincol') onto the region from
+ *                 ('dminrow', 'dmincol') to ('dmaxrow', 'dmaxcol') of the
+ *                 window pointed to by 'dstwin'.
+ *
+ *                 If 'overlay' is TRUE, cells showing the source's background
+ *                 character are left out, so that whatever is under them in
+ *                 the destination shows through (see 'blendcells').
+ *                 Otherwise, every cell is copied.
+ *
+ *                 Each row is copied in one go, and only the destination's
+ *                 rows are marked as changed. Neither cursor moves.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a region does not fit in its window.
+ *
+ * NOTES:          If the two regions share cells (such as within one window),
+ *                 the rows are copied so that none are overwritten before
+ *                 being read, but cells are only guaranteed to be copied
+ *                 correctly within a row when not overlaying.
+ *
+ *****************************************************************************/
+
+int copywin(const WINDOW *srcwin, WINDOW *dstwin, int sminrow, int smincol,
+		int dminrow, int dmincol, int dmaxrow, int dmaxcol, int overlay)
+{
+	CHAR_INFO *s, *d;
+	WCHAR blank;
+	int rows, cols, i, y;
+
+	/* Sanity check: NULL pointers */
+	if (!srcwin || !dstwin) return ERR;
+
+	/* Sanity check: the destination region is within its window */
+	if (sminrow < 0 || smincol < 0 || dminrow < 0 || dmincol < 0
+			|| dminrow > dmaxrow || dmincol > dmaxcol
+			|| dmaxrow >= dstwin->size.Y || dmaxcol >= dstwin->size.X)
+		return ERR;
+
+	/* Sanity check: so is the source region */
+	rows = dmaxrow - dminrow + 1;
+	cols = dmaxcol - dmincol + 1;
+	if (sminrow + rows > srcwin->size.Y || smincol + cols > srcwin->size.X)
+		return ERR;
+
+	/* The character which is left out when overlaying */
+	blank = srcwin->bkgd & A_CHARTEXT
+			? (WCHAR)(srcwin->bkgd & A_CHARTEXT) : WC_BGND;
+
+	for (i = 0; i < rows; i++) {
+		/* Go from the bottom up if the rows move down */
+		y = dminrow > sminrow ? rows - 1 - i : i;
+
+		/* Mark the row as changed, which also makes it ours to write to */
+		if (markdirty(dstwin, dminrow + y, dmincol, dmaxcol) == ERR)
+			return ERR;
+
+		/* Copy (or blend) the row */
+		s = &srcwin->line[sminrow + y][smincol];
+		d = &dstwin->line[dminrow + y][dmincol];
+		if (overlay)
+			blendcells(d, s, cols, blank);
+		else
+			memmove(d, s, sizeof(CHAR_INFO) * cols);
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * overlay
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the cells of the window pointed to by 'srcwin' onto
+ *                 the window pointed to by 'dstwin' where the two overlap on
+ *                 the screen, leaving out the source's blank cells.
+ *
+ *                 (See 'overlap' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the windows do not overlap.
+ *
+ *****************************************************************************/
+
+int overlay(const WINDOW *srcwin, WINDOW *dstwin)
+{
+	return overlap(srcwin, dstwin, TRUE);
+}
+
+
+/******************************************************************************
+ *
+ * overwrite
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies every cell of the window pointed to by 'srcwin' onto
+ *                 the window pointed to by 'dstwin' where the two overlap on
+ *                 the screen.
+ *
+ *                 (See 'overlap' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the windows do not overlap.
+ *
+ *****************************************************************************/
+
+int overwrite(const WINDOW *srcwin, WINDOW *dstwin)
+{
+	return overlap(srcwin, dstwin, FALSE);
+}
+
+
+/******************************************************************************
+ *
+ * printw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Prints the specified formatted string to 'stdscr'.
+ *
+ * RETURN VALUE:   Returns OK if the formatted string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int printw(char *fmt, ...)
+{
+	va_list args;
+	int r;
+
+	/* Argument initialization */
+	va_start(args, fmt);
+
+	/* Print our formatted string */
+	r = va_wprintw(stdscr, fmt, &args);
+
+	/* Argument cleanup */
+	va_end(args);
+
+	return r < 0 ? ERR : OK;
+}
+
+
+/******************************************************************************
+ *
+ * mvprintw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves to the desired coordinate (y, x) in 'stdscr' and
+ *                 and prints the specified formatted string.
+ *
+ * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvprintw(int y, int x, char *fmt, ...)
+{
+	/* Save our old cursor position in case it needs to be restored later */
+	wcoord_t oldcur = stdscr->cur;
+	va_list args;
+	int r = 0;
+
+	/* Argument initialization */
+	va_start(args, fmt);
+
+	/* Move to desired location in the desired window */
+	wmove(stdscr, y, x);
+
+	/* Print our formatted string */
+	r = va_wprintw(stdscr, fmt, &args);
+
+	/* If we were unable to print the string, */
+	if (r < 0)
+		/* Restore the original cursor location */
+		stdscr->cur = oldcur;
+
+	/* Argument cleanup */
+	va_end(args);
+
+	return r < 0 ? ERR : OK;
+}
+
+
+/******************************************************************************
+ *
+ * nodelay
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the 'no delay' mode of the window pointed to by 'win'
+ *                 depending on the value of 'bf'.
+ *
+ *                 If 'bf' is 'TRUE', 'no delay' mode is turned on and all
+ *                 input functions immediately return if there is no input
+ *                 present.
+ *
+ *                 Otherwise, 'no delay' mode is turned off and all input
+ *                 functions wait for input before returning.
+ *
+ * RETURN VALUE:   Returns OK if 'no delay' mode was set successfully.
+ *                 Otherwise, ERR is returned.
+ *
+ * NOTES:          This is the same as calling 'wtimeout' with a delay of zero
+ *                 (if 'bf' is 'TRUE') or a negative delay (otherwise).
+ *
+ *****************************************************************************/
+
+int nodelay(WINDOW *win, bool bf)
+{
+	/* Sanity check: make sure window exists */
+	if (!win) return ERR;
+
+	/* Either don't wait at all or wait forever */
+	wtimeout(win, bf == TRUE ? 0 : -1);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * timeout
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets how long input functions wait for a key press in
+ *                 stdscr.
+ *
+ *                 (See 'wtimeout' for more information.)
+ *
+ *****************************************************************************/
+
+void timeout(int delay)
+{
+	wtimeout(stdscr, delay);
+}
+
+
+/******************************************************************************
+ *
+ * wtimeout
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets how long input functions wait for a key press in the
+ *                 window pointed to by 'win'.
+ *
+ *                 If 'delay' is negative, input functions wait until a key is
+ *                 pressed. If it is zero, they return immediately if there is
+ *                 no input present (as in 'no delay' mode). Otherwise, they
+ *                 wait up to 'delay' milliseconds for a key press before
+ *                 giving up.
+ *
+ * NOTES:          Waiting is done by the operating system on the input
+ *                 handle, so the program uses no processor time until a key
+ *                 is pressed or the delay runs out.
+ *
+ *                 While in half-delay mode, the delay set by 'halfdelay' is
+ *                 used instead.
+ *
+ *****************************************************************************/
+
+void wtimeout(WINDOW *win, int delay)
+{
+	/* Sanity check: make sure window exists */
+	if (!win) return;
+
+	/* Treat any negative delay as waiting forever */
+	win->delay = delay < 0 ? -1 : delay;
+}
+
+
+/******************************************************************************
+ *
+ * wc_inputhandle
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Gets the console input handle, so that programs can wait
+ *                 for input together with objects of their own (such as
+ *                 sockets, timers, and events) using 'WaitForMultipleObjects'.
+ *
+ *                 The handle is signaled while console input is waiting to be
+ *                 read, which includes events which are not key presses (so
+ *                 a call to an input function may still find no keys).
+ *
+ *                 With the memory backend, the handle is an event which is
+ *                 set while records queued with 'wc_meminput' are waiting.
+ *
+ * RETURN VALUE:   Returns the console input handle.
+ *
+ * NOTES:          Key presses which have already been read from the console
+ *                 wait in the input queue, where they no longer signal the
+ *                 handle. After the handle is signaled, call 'wgetch' in 'no
+ *                 delay' mode until it returns ERR before waiting on the
+ *                 handle again.
+ *
+ *****************************************************************************/
+
+HANDLE wc_inputhandle(void)
+{
+	return hstdin;
+}
+
+
+/******************************************************************************
+ *
+ * wc_poll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Waits up to 'timeout' milliseconds (or forever if 'timeout'
+ *                 is negative) for input events or signaled handles, and
+ *                 stores up to 'max' of them in the array pointed to by
+ *                 'events'.
+ *
+ *                 Events are key presses (with the character and, whether or
+ *                 not 'keypad' mode is set, the key code 'wgetch' would
+ *                 translate it to), mouse events (see 'wc_mouse'), changes
+ *                 in the console size, the console window gaining or losing
+ *                 focus, and handles registered with 'wc_addhandle' which
+ *                 are signaled.
+ *
+ *                 If 'timeout' is zero, only events which are already waiting
+ *                 are stored.
+ *
+ * RETURN VALUE:   Returns the number of events stored, which is zero if the
+ *                 timeout ran out first. On failure, -1 is returned.
+ *
+ * NOTES:          All waiting is done in a single 'WaitForMultipleObjects'
+ *                 call on the console input handle and the registered
+ *                 handles, so a program can handle its input, output and
+ *                 timers from one thread without polling.
+ *
+ *                 Signaled handles are reported before console events, and
+ *                 the handle which ended the wait (which ending it may have
+ *                 reset) before any other. Events which don't fit are kept
+ *                 for the next call, and handles which don't fit are not
+ *                 waited on, so they stay signaled.
+ *
+ *                 A frame held back by the frame rate limit is written while
+ *                 waiting, as soon as it is due (see 'frametick'), so an
+ *                 event loop built on 'wc_poll' needs no timer of its own.
+ *
+ *                 With the memory backend, waiting forever with no handles
+ *                 registered returns zero once the input queued with
+ *                 'wc_meminput' has run out.
+ *
+ *****************************************************************************/
+
+int wc_poll(wcevent_t *events, int max, int timeout)
+{
+	HANDLE waits[MAXIMUM_WAIT_OBJECTS];
+	DWORD start, waited, left, r;
+	int n, i, fired, frame;
+
+	/* Sanity check: somewhere to store events */
+	if (!events || max < 1) return -1;
+
+	/* Note when we started, for working out how long is left to wait */
+	start = GetTickCount();
+
+	n = 0;
+	fired = -1;
+	for (;;) {
+		/*
+		 * Report the handle which woke us up first, since it can't be checked
+		 * again and must not be left out if the others fill 'events'
+		 */
+		if (fired >= 0) {
+			events[n].type = WC_EVHANDLE;
+			events[n].handle = uhandles[fired];
+			events[n].data = udata[fired];
+			n++;
+		}
+
+		/* Then the other registered handles which are signaled */
+		for (i = 0; i < nhandles && n < max; i++) {
+			if (i == fired) continue;
+			r = WaitForSingleObject(uhandles[i], 0);
+			if (r != WAIT_OBJECT_0 && r != WAIT_ABANDONED) continue;
+			events[n].type = WC_EVHANDLE;
+			events[n].handle = uhandles[i];
+			events[n].data = udata[i];
+			n++;
+		}
+
+		/*
+		 * Then whatever console events are waiting, resizing the screen for
+		 * changes in size (and dropping them if the size is the same)
+		 */
+		if (readevents(FALSE) == ERR) return -1;
+		while (n < max && evhead != evtail) {
+			events[n] = evq[evhead++ % WC_EVQ];
+			if (events[n].type == WC_EVRESIZE) {
+				if (!checksize()) continue;
+				events[n].pos = newscr->size;
+			}
+			n++;
+		}
+
+		/* Write a held back frame once it is due (see 'frametick') */
+		frame = frametick();
+
+		if (n || !timeout) return n;
+
+		/* Work out how much longer to wait */
+		if (timeout < 0)
+			left = INFINITE;
+		else {
+			waited = GetTickCount() - start;
+			if (waited >= (DWORD)timeout) return 0;
+			left = (DWORD)timeout - waited;
+		}
+
+		/* Wake up in time to write a held back frame */
+		if (frame >= 0 && (DWORD)frame < left) left = frame;
+
+		/* Nothing else can arrive once scripted input runs out */
+		if (output == &memoutput && !nhandles && !meminlen &&
+				left == INFINITE) return 0;
+
+		/* Sleep until there is input, a handle is signaled or time runs out */
+		waits[0] = hstdin;
+		memcpy(waits + 1, uhandles, sizeof(HANDLE) * nhandles);
+		r = WaitForMultipleObjects(nhandles + 1, waits, FALSE, left);
+		if (r == WAIT_FAILED) return -1;
+
+		/*
+		 * Waking us up resets auto-reset events, so remember which handle did
+		 * rather than checking it again
+		 */
+		if (r >= WAIT_OBJECT_0 + 1 && r <= WAIT_OBJECT_0 + nhandles)
+			fired = r - WAIT_OBJECT_0 - 1;
+		else if (r >= WAIT_ABANDONED + 1 && r <= WAIT_ABANDONED + nhandles)
+			fired = r - WAIT_ABANDONED - 1;
+	}
+}
+
+
+/******************************************************************************
+ *
+ * wc_addhandle
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Registers the handle 'h' (such as an event, a waitable
+ *                 timer, or a socket event from 'WSAEventSelect') to be
+ *                 waited on by 'wc_poll', which reports it along with the
+ *                 pointer 'data' whenever it is signaled.
+ *
+ *                 Registering a handle again only replaces its pointer.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise (such as when
+ *                 'WC_MAXHANDLES' handles are already registered), ERR is
+ *                 returned.
+ *
+ *****************************************************************************/
+
+int wc_addhandle(HANDLE h, void *data)
+{
+	int i;
+
+	/* Sanity check: a handle to wait on */
+	if (!h || h == INVALID_HANDLE_VALUE) return ERR;
+
+	/* Replace the pointer of a handle which is already registered */
+	for (i = 0; i < nhandles; i++) {
+		if (uhandles[i] == h) {
+			udata[i] = data;
+			return OK;
+		}
+	}
+
+	/* Sanity check: room for another handle */
+	if (nhandles == WC_MAXHANDLES) return ERR;
+
+	uhandles[nhandles] = h;
+	udata[nhandles] = data;
+	nhandles++;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wc_delhandle
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Stops 'wc_poll' from waiting on the handle 'h'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise (if 'h' is not registered),
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int wc_delhandle(HANDLE h)
+{
+	int i;
+
+	for (i = 0; i < nhandles; i++) {
+		if (uhandles[i] != h) continue;
+
+		/* Keep the remaining handles in the order they were registered */
+		memmove(uhandles + i, uhandles + i + 1,
+				sizeof(HANDLE) * (nhandles - i - 1));
+		memmove(udata + i, udata + i + 1, sizeof(void *) * (nhandles - i - 1));
+		nhandles--;
+
+		return OK;
+	}
+
+	return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * wc_mouse
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Turns the reporting of mouse events by 'wc_poll' on (if
+ *                 'bf' is 'TRUE') or off.
+ *
+ * RETURN VALUE:   Returns OK if reporting was changed successfully.
+ *                 Otherwise, ERR is returned.
+ *
+ * NOTES:          Turning reporting on also turns off the console's quick
+ *                 edit mode, which would otherwise take mouse input for
+ *                 selecting text. Turning it off again puts quick edit mode
+ *                 back the way it was.
+ *
+ *****************************************************************************/
+
+int wc_mouse(bool bf)
+{
+	DWORD mode;
+
+	/* The memory backend has no console modes to change */
+	if (output == &memoutput) return OK;
+
+	if (!GetConsoleMode(hstdin, &mode)) return ERR;
+
+	if (bf == TRUE) {
+		/* Remember whether quick edit mode was on (unless it is already off) */
+		if (!(mode & ENABLE_MOUSE_INPUT))
+			quickedit = mode & ENABLE_QUICK_EDIT_MODE;
+
+		/*
+		 * Quick edit mode can only be changed along with the extended flags,
+		 * so change everything in one call
+		 */
+		mode &= ~ENABLE_QUICK_EDIT_MODE;
+		mode |= ENABLE_MOUSE_INPUT | ENABLE_EXTENDED_FLAGS;
+	}
+	else {
+		/* Nothing to put back if reporting is not on */
+		if (!(mode & ENABLE_MOUSE_INPUT)) return OK;
+
+		mode &= ~ENABLE_MOUSE_INPUT;
+		mode |= quickedit | ENABLE_EXTENDED_FLAGS;
+	}
+
+	return SetConsoleMode(hstdin, mode) ? OK : ERR;
+}
+
+
+/******************************************************************************
+ *
+ * mvwprintw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves to the desired coordinate (y, x) in the window pointed
+ *                 to by 'win' and prints the specified formatted string.
+ *
+ * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int mvwprintw(WINDOW *win, int y, int x, char *fmt, ...)
+{
+	/* Save our old cursor position in case it needs to be restored later */
+	wcoord_t oldcur;
+	va_list args;
+	int r = 0;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+	oldcur = win->cur;
+
+	/* Argument initialization */
+	va_start(args, fmt);
+
+	/* Move to desired location in the desired window */
+	wmove(win, y, x);
+
+	/* Print our formatted string */
+	r = va_wprintw(win, fmt, &args);
+
+	/* If we were unable to print the string, */
+	if (r < 0)
+		/* Restore the original cursor location */
+		win->cur = oldcur;
+
+	/* Argument cleanup */
+	va_end(args);
+
+	return r < 0 ? ERR : OK;
+}
+
+
+/******************************************************************************
+ *
+ * wprintw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Prints the specified formatted string in the window pointed
+ *                 to by 'win'.
+ *
+ * RETURN VALUE:   Returns OK if the formatted stirng was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wprintw(WINDOW *win, char *fmt, ...)
+{
+	va_list args;
+	int r;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Argument initialization */
+	va_start(args, fmt);
+
+	/* Print our formatted string */
+	r = va_wprintw(win, fmt, &args);
+
+	/* Argument cleanup */
+	va_end(args);
+
+	return r < 0 ? ERR : OK;
+}
+
+
+/******************************************************************************
+ *
+ * attron
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables the attributes specified by the 'attrs' bit map in
+ *                 'stdscr'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int attron(int attrs)
+{
+	return wattron(stdscr, attrs);
+}
+
+
+/******************************************************************************
+ *
+ * attroff
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Disables the attributes specified by the 'attrs' bit map in
+ *                 'stdscr'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int attroff(int attrs)
+{
+	return wattroff(stdscr, attrs);
+}
+
+
+/******************************************************************************
+ *
+ * attrset
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables ONLY the attributes specified by the 'attrs' bit map
+ *                 in 'stdscr'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int attrset(int attrs)
+{
+	return wattrset(stdscr, attrs);
+}
+
+
+/******************************************************************************
+ *
+ * wattron
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables the attributes specified by the 'attrs' bit map in
+ *                 the window pointed to by 'win'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int wattron(WINDOW *win, int attrs)
+{
+	/* Set up our bit mask */
+	WORD bmask = getattrs(attrs);
+
+	/* Set our bit mask */
+	win->attrs |= bmask;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wattroff
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Disables the attributes specified by the 'attrs' bit map in
+ *                 the window pointed to by 'win'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int wattroff(WINDOW *win, int attrs)
+{
+	/* Set up our bit mask */
+	WORD bmask = getattrs(attrs);
+
+	/* Clear our bit mask */
+	win->attrs &= ~bmask;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * wattrset
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables ONLY the attributes specified by the 'attrs' bit map
+ *                 in the window pointed to by 'win'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int wattrset(WINDOW *win, int attrs)
+{
+	/* Set up our bit mask */
+	WORD bmask = getattrs(attrs);
+
+	/* Assign our bit mask */
+	win->attrs = bmask;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * getch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Reads a single character from 'stdscr'.
+ *
+ *                 (See 'wgetch' for more information.)
+ *
+ * RETURN VALUE:   Returns the character read or one of several KEY_*
+ *                 constants (if the 'keypad' flag is set).
+ *
+ *                 (See 'wincurses.h' and 'keypad' for more information.)
+ *
+ *****************************************************************************/
+
+int getch(void)
+{
+	return wgetch(stdscr);
+}
+
+
+/******************************************************************************
+ *
+ * mvgetch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and
+ *                 reads a single character from 'stdscr'.
+ *
+ *                 (See 'mvwgetch' for more information.)
+ *
+ * RETURN VALUE:   Returns the character read or one of several KEY_*
+ *                 constants (if the 'keypad' flag is set).
+ *
+ *                 (See 'wincurses.h' and 'keypad' for more information.)
+ *
+ *****************************************************************************/
+
+int mvgetch(int y, int x)
+{
+	return mvwgetch(stdscr, y, x);
+}
+
+
+/******************************************************************************
+ *
+ * mvwgetch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on the window pointed to by 'win'
+ *                 to ('y', 'x') and reads a single character from the window
+ *                 pointed to by 'win'.
+ *
+ *                 (See 'wmove' and 'wgetch' for more information.)
+ *
+ * RETURN VALUE:   Returns the character read or one of several KEY_* constants
+ *                 (if the 'keypad' flag is set).
+ *
+ *                 (See 'wincurses.h' and 'keypad' for more information.)
+ *
+ *****************************************************************************/
+
+int mvwgetch(WINDOW *win, int y, int x)
+{
+	/* Move to the desired location */
+	wmove(stdscr, y, x);
+
+	/* Get input from the window */
+	return wgetch(win);
+}
+
+
+/******************************************************************************
+ *
+ * wgetch
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Reads a single character from the window pointed to by
+ *                 'win'.
+ *
+ *                 Key presses are taken from the input queue, which is only
+ *                 refilled from the console (see 'readevents') once it is
+ *                 empty. Other events in the queue are discarded (see
+ *                 'wc_poll'). If the 'keypad' flag is set, special keys are
+ *                 translated with 'keymap' (see 'mapkey').
+ *
+ *                 If no key has been pressed, waits for the window's delay
+ *                 (see 'wtimeout') or, in half-delay mode, the delay set by
+ *                 'halfdelay'.
+ *
+ * RETURN VALUE:   Returns the character read or one of several KEY_*
+ *                 constants (if the 'keypad' flag is set). If no key was
+ *                 pressed before the delay ran out, ERR is returned.
+ *
+ *                 (See 'wincurses.h' and 'keypad' for more information.)
+ *
+ *****************************************************************************/
+
+int wgetch(WINDOW *win)
+{
+	wcevent_t c;
+	int r;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Wait until we have a key press or the delay runs out */
+	if (waitkeys(hdelay ? hdelay * 100 : win->delay) == ERR) return ERR;
+
+	/* Take the key press off of the queue */
+	c = evq[evhead++ % WC_EVQ];
+
+	/* The screen has already been resized, so just say so */
+	if (c.type == WC_EVRESIZE) return KEY_RESIZE;
+
+	/* Echo input if applicable */
+	if (flags & WC_ECHO) addch((unsigned char)c.ch);
+
+	/* By default, pass on the raw character value */
+	r = c.ch;
+
+	/* If we've chosen to translate special keys, return the key code */
+	if (win->flags & WC_WKEYPAD && c.key) r = c.key;
+
+	return r;
+}
+
+
+/******************************************************************************
+ *
+ * echo
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables 'echo' mode in which characters are written to the
+ *                 screen as they are typed.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int echo(void)
+{
+	/* Set the echo input flag */
+	flags |= WC_ECHO;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * noecho
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Disables 'echo' mode.
+ *
+ *                 (See 'echo' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+int noecho(void)
+{
+	/* Clear the echo input flag */
+	flags &= ~WC_ECHO;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * keypad
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    If 'bf' is 'TRUE', 'keypad' mode will be enabled in the
+ *                 window pointed to by 'win'.
+ *
+ *                 If 'bf' is 'FALSE', 'keypad' mode will be disabled in the
+ *                 window pointed to by 'win'.
+ *
+ *                 When in keypad mode, special character codes sent to the
+ *                 window pointed to by 'win' are translated to one of the
+ *                 KEY_* constants defined in 'wincurses.h'.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int keypad(WINDOW *win, bool bf)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* If the flag value is 'FALSE', */
+	if (bf == FALSE)
+		/* Unset the window's keypad flag */
+		win->flags &= ~WC_WKEYPAD;
+	/* Else, */
+	else
+		/* Set the window's keypad flag */
+		win->flags |= WC_WKEYPAD;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * cbreak
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables 'cbreak' mode in which input is processed as it is
+ *                 received but special character codes or combinations are
+ *                 handled by the operating system.
+ *
+ * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+int cbreak(void)
+{
+	/* Leave half-delay mode */
+	hdelay = 0;
+
+	/* Clear the enable line input flag */
+	if (clearmode(hstdin, ENABLE_LINE_INPUT) == ERR)
+		return ERR;
+
+	/* Set the enable processed input flag */
+	if (setmode(hstdin, ENABLE_PROCESSED_INPUT) == ERR)
+		return ERR;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * nocbreak
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Disables 'cbreak' mode.
+ *
+ *                 (See 'cbreak' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+int nocbreak(void)
+{
+	/* Leave half-delay mode */
+	hdelay = 0;
+
+	/* Set the enable line input and enable processed input flags */
+	return setmode(hstdin, ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+}
+
+
+/******************************************************************************
+ *
+ * halfdelay
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables 'half-delay' mode, which is like 'cbreak' mode
+ *                 except that input functions wait at most 'tenths' tenths of
+ *                 a second for a key press in every window, regardless of
+ *                 the window's own delay.
+ *
+ *                 Half-delay mode is left by calling 'nocbreak' (or 'cbreak'
+ *                 to stay in 'cbreak' mode).
+ *
+ * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
+ *                 is returned.
+ *
+ * NOTES:          'tenths' must be from 1 to 255.
+ *
+ *****************************************************************************/
+
+int halfdelay(int tenths)
+{
+	/* Sanity check: delay is in range */
+	if (tenths < 1 || tenths > 255) return ERR;
+
+	/* Half-delay mode handles input like 'cbreak' mode */
+	if (cbreak() == ERR) return ERR;
+
+	hdelay = tenths;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * raw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Enables 'raw' mode in which input is processed as it is
+ *                 received and ALL characters or character codes are passed on
+ *                 to the program.
+ *
+ * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+int raw(void)
+{
+	/* Leave half-delay mode */
+	hdelay = 0;
+
+	/* Clear the enable line input flag */
+	if (clearmode(hstdin, ENABLE_LINE_INPUT) == ERR)
+		return ERR;
+
+	/* Clear the enable processed input flag */
+	if (clearmode(hstdin, ENABLE_PROCESSED_INPUT) == ERR)
+		return ERR;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * noraw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Disables 'raw' mode.
+ *
+ *                 (See 'raw' for more information.)
+ *
+ * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+int noraw(void)
+{
+	/* Leave half-delay mode */
+	hdelay = 0;
+
+	/* Set the enable line input and enable processed input flags */
+	return setmode(hstdin, ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+}
+
+
+/******************************************************************************
+ *
+ * move
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x').
+ *
+ * RETURN VALUE:   Returns OK if the destination coordinates were within window
+ *                 bounds. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int move(int y, int x)
+{
+	return wmove(stdscr, y, x);
+}
+
+
+/******************************************************************************
+ *
+ * wmove
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x').
+ *
+ * RETURN VALUE:   Returns OK if the destination coordinates were within window
+ *                 bounds. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int wmove(WINDOW *win, int y, int x)
+{
+	/* Sanity check: within bounds? */
+	if (y >= win->size.Y || x >= win->size.X || y < 0 || x < 0)
+		return ERR;
+
+	/* Set the cursor position */
+	win->cur.Y = y;
+	win->cur.X = x;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * scrollok
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets whether the window pointed to by 'win' scrolls
+ *                 depending on the value of 'bf'.
+ *
+ *                 If 'bf' is 'TRUE', moving the cursor past the bottom row of
+ *                 the window's scrolling region, either with a newline or by
+ *                 wrapping, scrolls the region up by one row instead.
+ *
+ *                 Otherwise (the default), the cursor is left past the bottom
+ *                 of the window and 'wscrl' does nothing.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int scrollok(WINDOW *win, bool bf)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Set our flag appropriately */
+	if (bf == TRUE)
+		win->flags |= WC_SCROLLOK;
+	else
+		win->flags &= ~WC_SCROLLOK;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * setscrreg
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the scrolling region of 'stdscr'.
+ *
+ *                 (See 'wsetscrreg' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int setscrreg(int top, int bot)
+{
+	return wsetscrreg(stdscr, top, bot);
+}
+
+
+/******************************************************************************
+ *
+ * wsetscrreg
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the scrolling region of the window pointed to by 'win'
+ *                 to the rows from 'top' to 'bot', inclusive. Rows outside of
+ *                 the region are never moved by scrolling.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the region does not fit within the window.
+ *
+ *****************************************************************************/
+
+int wsetscrreg(WINDOW *win, int top, int bot)
+{
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Sanity check: within bounds? */
+	if (top < 0 || bot >= win->size.Y || top > bot) return ERR;
+
+	win->top = top;
+	win->bot = bot;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * scroll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the scrolling region of the window pointed to by
+ *                 'win' up by one row.
+ *
+ *                 (See 'wscrl' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int scroll(WINDOW *win)
+{
+	return wscrl(win, 1);
+}
+
+
+/******************************************************************************
+ *
+ * scrl
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the scrolling region of 'stdscr' by 'n' rows.
+ *
+ *                 (See 'wscrl' for more information.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int scrl(int n)
+{
+	return wscrl(stdscr, n);
+}
+
+
+/******************************************************************************
+ *
+ * wscrl
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the scrolling region of the window pointed to by
+ *                 'win' up by 'n' rows, or down if 'n' is negative. Rows
+ *                 exposed by scrolling are filled with the character 'WC_BGND'
+ *                 using the window's current attributes. The cursor does not
+ *                 move.
+ *
+ *                 Scrolling only changes the window's cells. 'refresh' notices
+ *                 that the rows have moved and scrolls the console to match.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when scrolling has not been enabled with 'scrollok'.
+ *
+ *****************************************************************************/
+
+int wscrl(WINDOW *win, int n)
+{
+	CHAR_INFO fill;
+
+	/* Sanity check: NULL pointer */
+	if (!win) return ERR;
+
+	/* Sanity check: scrolling allowed? */
+	if (!(win->flags & WC_SCROLLOK)) return ERR;
+
+	/* Move the rows of the region, filling in behind them */
+	fill = bkgdcell(win);
+	return n ? shiftcells(win, win->top, win->bot, n, fill) : OK;
+}
+
+
+/******************************************************************************
+ *
+ * can_change_color
+ *
+ ******************************************************************************
+ *
+ * RETURN VALUE:   Returns TRUE if the terminal supports user-defined colors,
+ *                 Otherwise, FALSE is returned.
+ *
+ *****************************************************************************/
+
+bool can_change_color(void)
+{
+	return CAN_CHANGE_COLOR;
+}
+
+
+/******************************************************************************
+ *
+ * color_content
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Given a color number, assigns pointers to the red, green,
+ *                 and blue color components for the color indexed in the
+ *                 'colors' array by 'color'. The pointers are assigned to
+ *                 'red', 'green', and 'blue', respectively.
+ *
+ * RETURN VALUE:   Returns the color pair value if colors are available.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int color_content(short color, short *red, short *green, short *blue)
+{
+	/* Make sure we are using colors and have values within range */
+	if (flags & WC_COLOR && has_colors() && can_change_color() &&
+			color < COLORS && color > 0) {
+		/* Assign pointers to our color values */
+		red   = &colors[color].r;
+		green = &colors[color].g;
+		blue  = &colors[color].b;
+		return OK;
+	} else return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * COLOR_PAIR
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Given a color pair number, returns the value as it would be
+ *                 extracted from a chtype.
+ *
+ * RETURN VALUE:   Returns the color pair value of the given color pair number.
+ *
+ *****************************************************************************/
+
+int COLOR_PAIR(int n)
+{
+	/* Return the high-order color bits (shifted unsigned, into the sign bit) */
+	return (int)((chtype)n << (32 - COLOR_BITS));
+}
+
+
+/******************************************************************************
+ *
+ * has_colors
+ *
+ ******************************************************************************
+ *
+ * RETURN VALUE:   Returns TRUE if the terminal supports colors. Otherwise,
+ *                 FALSE is returned.
+ *
+ *****************************************************************************/
+
+bool has_colors(void)
+{
+	COLORS = 0;
+	COLOR_PAIRS = 0;
+
+	if (HAS_COLORS == TRUE) {
+		/* Set up our global variables */
+		COLORS = NUM_COLORS;
+		COLOR_PAIRS = MAX_NUM_PAIRS;
+	}
+
+	return HAS_COLORS;
+}
+
+
+/******************************************************************************
+ *
+ * init_color
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Initializes a user-defined color by replacing an old one.
+ *
+ *                 'color' refers to the existing color to be replaced by the
+ *                 red, green, and blue intensities given by 'red', 'green',
+ *                 and 'blue', respectively, all within the range of 0 to 1000,
+ *                 inclusive.
+ *
+ * RETURN VALUE:   Returns OK if the color was set up correctly. Otherwise, ERR
+ *                 is returned.
+ *
+ * NOTES:          Windows does not support this functionality. However, for
+ *                 completeness, we have set up a framework if it were to be
+ *                 emulated somehow.
+ *
+ *                 Basically, though we are using Windows console flags to
+ *                 control color usage, we actually are able to address RGB
+ *                 values.
+ *
+ *                 Namely, colors are applied based upon color pair data stored
+ *                 in each window's 'attrs' variable. (In fact, the color pair
+ *                 can be extracted using the 'A_COLOR_DATA' macro, passing it
+ *                 the 'attrs' variable in question.) This, in turn, merely
+ *                 points to an index in the global 'color_pairs' array, which
+ *                 contains a listing of 'color_t' foreground and background
+ *                 colors.
+ *
+ *                 This feature has not beed tested and code is provided mainly
+ *                 for demonstration purposes.
+ *
+ *****************************************************************************/
+
+int init_color(short color, short red, short green, short blue)
+{
+	short pair;
+
+	/* Make sure we are using colors and have values within range */
+	if (flags & WC_COLOR && has_colors() && can_change_color() &&
+			color < COLORS && color > 0) {
+		/* Make sure our color values are within range */
+		if (red > 1000 || green > 1000 || blue > 1000 ||
+				red < 0 || green < 0 || blue < 0)
+			return ERR;
+
+		/* TODO: Add support for custom colors */
+		/* Assign our color value */
+		colors[color].r = red;
+		colors[color].g = green;
+		colors[color].b = blue;
+
+		/* Work out the flags of the color pairs using it again */
+		for (pair = 0; pair < MAX_NUM_PAIRS; pair++)
+			if (color_pairs[pair].f == color || color_pairs[pair].b == color)
+				pairattrs[pair] = pairmask(pair);
+
+		return OK;
+	} else return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * init_pair
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Initializes a pair of foreground and background colors for
+ *                 later use.
+ *
+ *                 Both 'f' and 'b' refer to indices within the global 'colors'
+ *                 array.
+ *
+ * RETURN VALUE:   Returns OK if the color pair was set up correctly.
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int init_pair(short pair, short f, short b)
+{
+	/*
+	 * Make sure we are using colors and have values within range. (Note that
+	 * we do not change pair number zero as it is the default console
+	 * foreground and background.)
+	 */
+	if (flags & WC_COLOR && has_colors() && pair < COLOR_PAIRS && pair > 0
+			&& f >= 0 && f < COLORS && b >= 0 && b < COLORS) {
+		/* Assign our color values */
+		color_pairs[pair].f = f;
+		color_pairs[pair].b = b;
+
+		/* Work out the pair's console flags */
+		pairattrs[pair] = pairmask(pair);
+		return OK;
+	} else return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * pair_content
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Modifies 'f' and 'b' to point to the respective foreground
+ *                 and background values for the given pair.
+ *
+ * RETURN VALUE:   Returns OK if the color pair was accessible. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+int pair_content(short pair, short *f, short *b)
+{
+	/* Make sure we are using colors and have values within range */
+	if (flags & WC_COLOR && has_colors() && pair < COLOR_PAIRS && pair >= 0) {
+		/* Assign our color pointer values */
+		f = &color_pairs[pair].f;
+		b = &color_pairs[pair].b;
+		return OK;
+	} else return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * PAIR_NUMBER
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    (See 'A_COLOR_DATA' in 'wincurses.h' for more information.)
+ *
+ * RETURN VALUE:   Returns the color pair number given a color pair value.
+ *
+ *****************************************************************************/
+
+int PAIR_NUMBER(int value)
+{
+	return A_COLOR_DATA((chtype)value);
+}
+
+
+/******************************************************************************
+ *
+ * start_color
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Initializes color mode for the console. Namely, it sets up
+ *                 the bit masks for the various console colors, sets the
+ *                 console colors to the default set (white foreground text on
+ *                 a black background) and turns colors on globally.
+ *
+ * RETURN VALUE:   Returns OK if colors were set up correctly on the console
+ *                 Otherwise, ERR is returned.
+ *
+ *****************************************************************************/
+
+int start_color(void)
+{
+	short pair;
+
+	/* Make sure we are using colors */
+	if (has_colors()) {
+		/* Initialize the eight basic console colors */
+		colors[COLOR_BLACK].r   = 0;
+		colors[COLOR_BLACK].g   = 0;
+		colors[COLOR_BLACK].b   = 0;
+
+		colors[COLOR_BLUE].r    = 0;
+		colors[COLOR_BLUE].g    = 0;
+		colors[COLOR_BLUE].b    = 1000;
+
+		colors[COLOR_GREEN].r   = 0;
+		colors[COLOR_GREEN].g   = 1000;
+		colors[COLOR_GREEN].b   = 0;
+
+		colors[COLOR_CYAN].r    = 0;
+		colors[COLOR_CYAN].g    = 1000;
+		colors[COLOR_CYAN].b    = 1000;
+
+		colors[COLOR_RED].r     = 1000;
+		colors[COLOR_RED].g     = 0;
+		colors[COLOR_RED].b     = 0;
+
+		colors[COLOR_MAGENTA].r = 1000;
+		colors[COLOR_MAGENTA].g = 0;
+		colors[COLOR_MAGENTA].b = 1000;
+
+		colors[COLOR_YELLOW].r  = 1000;
+		colors[COLOR_YELLOW].g  = 1000;
+		colors[COLOR_YELLOW].b  = 0;
+
+		colors[COLOR_WHITE].r   = 1000;
+		colors[COLOR_WHITE].g   = 1000;
+		colors[COLOR_WHITE].b   = 1000;
+
+		/* Work out the console flags of every color pair with these colors */
+		for (pair = 0; pair < MAX_NUM_PAIRS; pair++)
+			pairattrs[pair] = pairmask(pair);
+
+		/* Set up the console defaults */
+		init_pair(0, COLOR_WHITE, COLOR_BLACK);
+		attrset(COLOR_PAIR(0));
+
+		/* Turn colors on globally */
+		flags |= WC_COLOR;
+
+		return OK;
+	} else return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * curs_set
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the visibility mode of the cursor depending on the
+ *                 value of 'visibility'.
+ *
+ *                 0 means make the cursor invisible.
+ *                 1 means make the cursor normal visibility.
+ *                 2 means make the cursor have increased visibility.
+ *
+ * RETURN VALUE:   Returns OK if cursor visibility was set correctly. Otherwise
+ *                 ERR is returned.
+ *
+ *****************************************************************************/
+
+int curs_set(int visibility)
+{
+	int r;
+
+	/* Another thread may be updating the screen */
+	EnterCriticalSection(&scrlock);
+
+	/* Wait until the render thread is done with the output backend */
+	renderwait();
+
+	/* Let the output backend do the work */
+	r = output->curs(visibility);
+
+	LeaveCriticalSection(&scrlock);
+
+	return r;
+}
+
+
+/******************************************************************************
+ * Output backend functions follow.
+ *****************************************************************************/
+
+
+/******************************************************************************
+ *
+ * coninit
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets up the console backend by creating the primary and back
+ *                 buffers (or just the primary buffer in single buffer mode)
+ *                 and making the primary buffer active.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int coninit(void)
+{
+	/* Set up our primary and back buffer indices */
+	prim = 0;
+	bbuf = flags & WC_SINGLEBUF ? 0 : 1;
+
+	/* Create our console buffers */
+	hcon[prim] = CreateConsoleScreenBuffer(
+			GENERIC_WRITE | GENERIC_READ,
+			FILE_SHARE_WRITE | FILE_SHARE_READ,
+			NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+
+	/* Sanity check: console buffer successfully created */
+	if (hcon[prim] == INVALID_HANDLE_VALUE) return ERR;
+
+	/* Only create a back buffer if we are not in single buffer mode */
+	if (bbuf != prim) {
+		hcon[bbuf] = CreateConsoleScreenBuffer(
+				GENERIC_WRITE | GENERIC_READ,
+				FILE_SHARE_WRITE | FILE_SHARE_READ,
+				NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+
+		/* Sanity check: console buffer successfully created */
+		if (hcon[bbuf] == INVALID_HANDLE_VALUE) return ERR;
+	}
+
+	/* Set the size of our buffers to match the window size */
+	if (!SetConsoleScreenBufferSize(hcon[prim], tocoord(stdscr->size)))
+		return ERR;
+	if (!SetConsoleScreenBufferSize(hcon[bbuf], tocoord(stdscr->size)))
+		return ERR;
+
+	/* Clear our buffers */
+	cls(hcon[prim]);
+	cls(hcon[bbuf]);
+
+	/* Set the primary buffer as the current console screen buffer */
+	if (!SetConsoleActiveScreenBuffer(hcon[prim])) return ERR;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * conscroll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the rows from 'top' to 'bot', inclusive, of the back
+ *                 buffer up by 'n' rows, or down if 'n' is negative.
+ *
+ *                 The primary buffer is on display, so scrolling it is put off
+ *                 until 'conflush' has swapped the buffers.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conscroll(int top, int bot, int n)
+{
+	/* Scroll the back buffer right away */
+	if (conshift(hcon[bbuf], top, bot, n) == ERR) return ERR;
+
+	/* Leave the primary buffer for later (unless it is the same buffer) */
+	if (bbuf != prim) {
+		scrtop = top;
+		scrbot = bot;
+		scrn = n;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * conshift
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the rows from 'top' to 'bot', inclusive, of the
+ *                 console screen buffer with handle 'hcon' up by 'n' rows, or
+ *                 down if 'n' is negative, with a single console call.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conshift(HANDLE hcon, int top, int bot, int n)
+{
+	SMALL_RECT rect, clip;
+	COORD dest;
+	CHAR_INFO fill;
+
+	/* Nothing outside of the region may change */
+	clip.Top = top;
+	clip.Bottom = bot;
+	clip.Left = 0;
+	clip.Right = curscr->size.X - 1;
+
+	/* Move the rows which stay within the region */
+	rect = clip;
+	dest.X = 0;
+	if (n > 0) {
+		rect.Top = top + n;
+		dest.Y = top;
+	}
+	else {
+		rect.Bottom = bot + n;
+		dest.Y = top - n;
+	}
+
+	/*
+	 * The exposed rows are filled with the background character. (They are
+	 * written over anyway, so use attributes a render thread can't race on.)
+	 */
+	fill.Char.UnicodeChar = WC_BGND;
+	fill.Attributes = curscr->attrs;
+
+	if (!ScrollConsoleScreenBufferW(hcon, &rect, &clip, dest, &fill))
+		return ERR;
+	concalls++;
+	WC_COUNT(scrolls, 1);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * conflush
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Writes the 'n' spans of cells in the 'spans' array from the
+ *                 window pointed to by 'win' to the back buffer, moves the
+ *                 cursor, and then swaps the primary and back buffers. The new
+ *                 back buffer is then scrolled (see 'conscroll') and written
+ *                 to so that it matches.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conflush(WINDOW *win, SMALL_RECT *spans, int n)
+{
+	SMALL_RECT whole;
+
+	/* Write the changed cells to the back buffer */
+	if (flushcells(win, hcon[bbuf], spans, n) == ERR)
+		return ERR;
+
+	/* Move our cursor to the correct position */
+	SetConsoleCursorPosition(hcon[bbuf], tocoord(win->cur));
+	concalls++;
+
+	/* In single buffer mode, we have been writing to the console directly */
+	if (bbuf != prim) {
+		/* Set the back buffer as the current console screen buffer */
+		SetConsoleActiveScreenBuffer(hcon[bbuf]);
+		concalls++;
+
+		/* Now that it is hidden, scroll the primary buffer to match */
+		if (scrn) {
+			if (conshift(hcon[prim], scrtop, scrbot, scrn) == ERR)
+				return ERR;
+			scrn = 0;
+		}
+
+		/*
+		 * Write the same cells to the primary buffer for persistency.
+		 * (Remember: the buffers are swapped IN APPEARANCE at this point, but
+		 * not IN NOTATION. We are looking at hcon[bbuf], so hcon[prim] is our
+		 * new back buffer and must catch up with the changes it has not seen
+		 * yet.)
+		 *
+		 * If the console rearranged the primary buffer when it was resized,
+		 * write all of it instead, now that nobody can see it being done.
+		 */
+		if (constale) {
+			whole.Top = whole.Left = 0;
+			whole.Bottom = win->size.Y - 1;
+			whole.Right = win->size.X - 1;
+			if (flushcells(win, hcon[prim], &whole, 1) == ERR)
+				return ERR;
+			constale = FALSE;
+		}
+		else if (flushcells(win, hcon[prim], spans, n) == ERR)
+			return ERR;
+
+		/* 'Swap' the primary and back buffers by swapping their values */
+		bbuf = !(prim = !prim);
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * conresize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Resizes the console buffers to 'lines' rows and 'cols'
+ *                 columns after the console has been resized.
+ *
+ *                 The cells the buffers keep are assumed to be unchanged, so
+ *                 that only the newly exposed cells have to be written. The
+ *                 console may have rearranged the cells of the buffer on
+ *                 display to fit its new size, though, so that buffer is
+ *                 rewritten in full once it is hidden (see 'conflush'). In
+ *                 single buffer mode, where it is never hidden, every cell is
+ *                 written by the next update instead.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conresize(int lines, int cols)
+{
+	/* Resize the buffer on display, and the back buffer if there is one */
+	if (consize(hcon[prim], lines, cols) == ERR) return ERR;
+	if (bbuf != prim && consize(hcon[bbuf], lines, cols) == ERR) {
+		/* Put the buffer on display back to the size of the screen */
+		consize(hcon[prim], curscr->size.Y, curscr->size.X);
+		return ERR;
+	}
+
+	/* Redraw the whole screen with the next update (see 'clearok') */
+	if (bbuf != prim)
+		constale = TRUE;
+	else
+		curscr->flags |= WC_CLEAROK;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * consize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Makes the console screen buffer with handle 'hcon' and its
+ *                 window 'lines' rows by 'cols' columns, with the window in
+ *                 the upper left corner of the buffer.
+ *
+ *                 A buffer can never be smaller than its window, so the
+ *                 buffer is first grown to fit both sizes (if needed), then
+ *                 the window is set, and then the buffer is cut down to
+ *                 match.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int consize(HANDLE hcon, int lines, int cols)
+{
+	CONSOLE_SCREEN_BUFFER_INFO coninfo;
+	SMALL_RECT rect;
+	COORD size;
+
+	if (!GetConsoleScreenBufferInfo(hcon, &coninfo)) return ERR;
+	concalls++;
+
+	/* Grow the buffer enough to hold the new window */
+	size = coninfo.dwSize;
+	if (size.Y < lines) size.Y = (SHORT)lines;
+	if (size.X < cols) size.X = (SHORT)cols;
+	if (size.Y != coninfo.dwSize.Y || size.X != coninfo.dwSize.X) {
+		if (!SetConsoleScreenBufferSize(hcon, size)) return ERR;
+		concalls++;
+	}
+
+	/* Put the window in the upper left corner */
+	rect.Top = rect.Left = 0;
+	rect.Bottom = (SHORT)(lines - 1);
+	rect.Right = (SHORT)(cols - 1);
+	if (!SetConsoleWindowInfo(hcon, TRUE, &rect)) return ERR;
+	concalls++;
+
+	/* Cut the buffer down to the size of the window */
+	if (size.Y != lines || size.X != cols) {
+		size.Y = (SHORT)lines;
+		size.X = (SHORT)cols;
+		if (!SetConsoleScreenBufferSize(hcon, size)) return ERR;
+		concalls++;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * concurs
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the visibility of the cursor in the console backend's
+ *                 buffers.
+ *
+ *                 (See 'curs_set' for more information.)
+ *
+ * RETURN VALUE:   Returns the previous cursor visibility if it was set
+ *                 correctly. Otherwise ERR is returned.
+ *
+ *****************************************************************************/
+
+static int concurs(int visibility)
+{
+	int r;
+	CONSOLE_CURSOR_INFO curinfo, curold;
+
+	/* Get our old cursor information */
+	r = GetConsoleCursorInfo(hcon[prim], &curold);
+	if (!r) return ERR;
+
+	/* Copy our old cursor information to our new cursor */
+	curinfo = curold;
+
+	/* Assign the proper visibility */
+	switch (visibility) {
+		case 0:		/* Invisible */
+			curinfo.bVisible = FALSE;
+			break;
+		case 1:		/* Normal visibility */
+			curinfo.bVisible = TRUE;
+			curinfo.dwSize = cursize;
+			break;
+		case 2:		/* High visibility */
+			curinfo.bVisible = TRUE;
+			curinfo.dwSize = 100;
+			break;
+		default:
+			return ERR;
+	}
+
+	/* Apply the new visibility settings to all buffers */
+	r = SetConsoleCursorInfo(hcon[prim], &curinfo);
+	r |= SetConsoleCursorInfo(hcon[bbuf], &curinfo);
+	if (!r) return ERR;
+
+	/* Return our old state */
+	if (curold.bVisible == FALSE) return 0;
+	if (curold.dwSize == cursize) return 1;
+	return 2;
+}
+
+/******************************************************************************
+ *
+ * conread
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Reads up to 'len' records from the console's input into
+ *                 the array pointed to by 'recs', and stores how many were
+ *                 read in 'n'. (This is shared by the console and virtual
+ *                 terminal backends.)
+ *
+ *                 If 'wait' is 'TRUE', waits for at least one record to
+ *                 read. Otherwise, only reads records which are already
+ *                 waiting.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conread(INPUT_RECORD *recs, DWORD len, DWORD *n, bool wait)
+{
+	/* Don't wait if there is nothing to read */
+	if (!wait) {
+		if (!GetNumberOfConsoleInputEvents(hstdin, n)) return ERR;
+		if (!*n) return OK;
+	}
+
+	return ReadConsoleInput(hstdin, recs, len, n) ? OK : ERR;
+}
+
+
+/******************************************************************************
+ *
+ * conwinsize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Stores the number of rows and columns of the console's
+ *                 window in 'lines' and 'cols'. (This is shared by the
+ *                 console and virtual terminal backends.)
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conwinsize(int *lines, int *cols)
+{
+	CONSOLE_SCREEN_BUFFER_INFO coninfo;
+
+	/* Ask the buffer on display (ours, unless using terminal sequences) */
+	if (!GetConsoleScreenBufferInfo(output == &conoutput ? hcon[prim] : hstdout,
+			&coninfo))
+		return ERR;
+
+	*lines = coninfo.srWindow.Bottom - coninfo.srWindow.Top + 1;
+	*cols = coninfo.srWindow.Right - coninfo.srWindow.Left + 1;
+
+	return OK;
+}
+
+
+
+/******************************************************************************
+ *
+ * conend
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Restores the original console buffer and closes the console
+ *                 backend's buffers.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int conend(void)
+{
+	/* Restore our saved stdout */
+	SetConsoleActiveScreenBuffer(hstdout);
+
+	/* Close the handle to our buffers */
+	CloseHandle(hcon[prim]);
+	if (bbuf != prim)
+		CloseHandle(hcon[bbuf]);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtinit
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets up the virtual terminal backend by turning on virtual
+ *                 terminal processing for the original console buffer and
+ *                 switching to the terminal's alternate screen.
+ *
+ *                 Line wrapping is turned off so that writing to the last
+ *                 column never moves the cursor onto the next row.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the console does not support virtual terminal
+ *                 sequences.
+ *
+ *****************************************************************************/
+
+static int vtinit(void)
+{
+	DWORD mode;
+
+	/* Remember the console mode so that it can be restored later */
+	if (!GetConsoleMode(hstdout, &vtmode)) return ERR;
+
+	/*
+	 * Likewise the output code page, before switching it to UTF-8. (If that
+	 * fails, put the console mode back for the console backend.)
+	 */
+	vtcp = GetConsoleOutputCP();
+	if (!SetConsoleOutputCP(CP_UTF8)) {
+		SetConsoleMode(hstdout, vtmode);
+		return ERR;
+	}
+
+	/*
+	 * Turn on virtual terminal processing. (Consoles too old for it refuse,
+	 * so put everything back for the console backend.)
+	 */
+	mode = vtmode | ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+	if (!SetConsoleMode(hstdout, mode)) {
+		SetConsoleOutputCP(vtcp);
+		SetConsoleMode(hstdout, vtmode);
+		return ERR;
+	}
+
+	/* Nothing is known about the terminal's cursor or attributes yet */
+	vtcur.Y = vtcur.X = -1;
+	vtattr = -1;
+	vtvis = 1;
+	vtlen = 0;
+
+	/* Switch to the alternate screen and turn off line wrapping */
+	VTPUTS("\x1b[?1049h\x1b[?7l");
+
+	return vtwrite();
+}
+
+
+/******************************************************************************
+ *
+ * vtscroll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the sequences which scroll the rows from 'top' to
+ *                 'bot', inclusive, up by 'n' rows, or down if 'n' is
+ *                 negative. Unless the whole screen scrolls, the terminal's
+ *                 scrolling margins are set around the rows first and reset
+ *                 afterwards.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtscroll(int top, int bot, int n)
+{
+	int whole = top == 0 && bot == newscr->size.Y - 1;
+
+	/* Set the scrolling margins */
+	if (!whole && (VTPUTS("\x1b[") == ERR || vtint(top + 1) == ERR
+			|| VTPUTS(";") == ERR || vtint(bot + 1) == ERR
+			|| VTPUTS("r") == ERR))
+		return ERR;
+
+	/* Scroll up or down (the count is optional when it is one) */
+	if (VTPUTS("\x1b[") == ERR) return ERR;
+	if (abs(n) != 1 && vtint(abs(n)) == ERR) return ERR;
+	if ((n > 0 ? VTPUTS("S") : VTPUTS("T")) == ERR) return ERR;
+
+	if (!whole) {
+		/* Reset the scrolling margins */
+		if (VTPUTS("\x1b[r") == ERR) return ERR;
+
+		/* Setting the margins moved the cursor home */
+		vtcur.Y = vtcur.X = 0;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtflush
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Writes the 'n' spans of cells in the 'spans' array from the
+ *                 window pointed to by 'win' as virtual terminal sequences and
+ *                 moves the cursor, all with a single console call.
+ *
+ *                 The cursor is moved between spans as cheaply as possible
+ *                 (see 'vtmove'), and attributes are only changed when they
+ *                 differ from those of the previous cell written.
+ *
+ *                 Blank cells which run to the end of a row are erased with
+ *                 a single sequence (EL) instead of being written, and so are
+ *                 all of the rows below them if those are entirely blank (ED),
+ *                 which makes clearing the screen cheap. (See 'vtblanks'.)
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ * NOTES:          Characters are written as UTF-8 (the console's output code
+ *                 page is switched by 'vtinit'). Control characters are written
+ *                 as 'WC_BGND' so that they cannot be mistaken for terminal
+ *                 commands.
+ *
+ *****************************************************************************/
+
+static int vtflush(WINDOW *win, SMALL_RECT *spans, int n)
+{
+	CHAR_INFO *c;
+	WCHAR wc;
+	WORD a, eda = 0;
+	char *p, erase;
+	int i, j, y, x, right, t, edrow, edy = win->size.Y;
+
+	/*
+	 * Find the rows at the bottom which are entirely blank, with the same
+	 * attributes, so that they can be erased all at once
+	 */
+	for (edrow = win->size.Y; edrow > 0; edrow--) {
+		if (vtblanks(win, edrow - 1, &a) > 0
+				|| (edrow < win->size.Y && a != eda))
+			break;
+		eda = a;
+	}
+
+	for (i = 0; i < n; i++) {
+		/* Leave out the rows which have already been erased */
+		for (y = spans[i].Top; y <= spans[i].Bottom && y < edy; y++) {
+			right = spans[i].Right;
+			erase = 0;
+
+			/*
+			 * If this is the last span on the row, see if it ends in blank
+			 * cells which run to the end of the row, so that they can be
+			 * erased instead. (If the rows below are blank as well, erase
+			 * those too.)
+			 */
+			for (j = i + 1; j < n && spans[j].Top <= y; j++)
+				if (spans[j].Bottom >= y) break;
+			if ((j == n || spans[j].Top > y)
+					&& (t = vtblanks(win, y, &a)) <= right) {
+				if (t < spans[i].Left) t = spans[i].Left;
+				if (y + 1 < win->size.Y && y + 1 >= edrow && a == eda) {
+					erase = 'J';
+					edy = y + 1;
+				}
+				else if (right - t + 1 > 3) {
+					erase = 'K';
+				}
+				if (erase) right = t - 1;
+			}
+
+			/* Move to the start of the span on this row */
+			if (vtmove(win, y, spans[i].Left) == ERR) return ERR;
+
+			for (x = spans[i].Left; x <= right; x++) {
+				c = &win->line[y][x];
+
+				/* Change attributes if we need to */
+				if (vtsgr(c->Attributes) == ERR) return ERR;
+
+				/* Write the character, leaving out control characters */
+				wc = c->Char.UnicodeChar;
+				if (wc < ' ' || (wc >= 0x7f && wc < 0xa0)) wc = WC_BGND;
+				p = vtreserve(3);
+				if (!p) return ERR;
+				vtlen += utf8enc(wc, p);
+			}
+
+			/* The cursor stops at the last column since wrapping is off */
+			if (right >= spans[i].Left)
+				vtcur.X = right + 1 < win->size.X ? right + 1 : win->size.X - 1;
+
+			/* Erase the rest, which leaves the cursor where it is */
+			if (erase && (vtsgr(a) == ERR || VTPUTS("\x1b[") == ERR
+					|| vtput(&erase, 1) == ERR))
+				return ERR;
+		}
+	}
+
+	/* Move our cursor to the correct position, if it is on the screen */
+	if (win->cur.Y < win->size.Y && vtmove(win, win->cur.Y, win->cur.X) == ERR)
+		return ERR;
+
+	/* Write everything out at once */
+	return vtwrite();
+}
+
+
+/******************************************************************************
+ *
+ * vtblanks
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Finds the run of blank cells which ends row 'y' of the
+ *                 window pointed to by 'win', all with the same attributes,
+ *                 and saves those attributes to the location pointed to by
+ *                 'attrs'.
+ *
+ *                 Only cells which the terminal would leave the same when
+ *                 erasing them with those attributes in effect count as blank,
+ *                 so reverse video and underlined blanks do not.
+ *
+ * RETURN VALUE:   Returns the first column of the run, which is the width of
+ *                 the window if there is none.
+ *
+ *****************************************************************************/
+
+static int vtblanks(WINDOW *win, int y, WORD *attrs)
+{
+	CHAR_INFO *c = win->line[y];
+	int x = win->size.X;
+
+	/* Erasing fills cells with spaces in the current colors only */
+	*attrs = c[x - 1].Attributes;
+	if (*attrs & (COMMON_LVB_REVERSE_VIDEO | COMMON_LVB_UNDERSCORE)) return x;
+
+	while (x > 0 && c[x - 1].Char.UnicodeChar == ' '
+			&& c[x - 1].Attributes == *attrs)
+		x--;
+
+	return x;
+}
+
+
+/******************************************************************************
+ *
+ * vtresize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Follows a change in the size of the terminal to 'lines'
+ *                 rows and 'cols' columns.
+ *
+ *                 The terminal resizes its own screen and keeps the cells
+ *                 which are left, but it may have moved the cursor to keep it
+ *                 on the screen, so where the cursor is is no longer known.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+static int vtresize(int lines, int cols)
+{
+	vtcur.Y = vtcur.X = -1;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtcurs
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the visibility of the terminal's cursor. (High
+ *                 visibility is shown as a steady block cursor.)
+ *
+ *                 (See 'curs_set' for more information.)
+ *
+ * RETURN VALUE:   Returns the previous cursor visibility if it was set
+ *                 correctly. Otherwise ERR is returned.
+ *
+ *****************************************************************************/
+
+static int vtcurs(int visibility)
+{
+	int old = vtvis;
+
+	/* Queue the proper sequence */
+	switch (visibility) {
+		case 0:		/* Invisible */
+			VTPUTS("\x1b[?25l");
+			break;
+		case 1:		/* Normal visibility */
+			VTPUTS("\x1b[?25h\x1b[0 q");
+			break;
+		case 2:		/* High visibility */
+			VTPUTS("\x1b[?25h\x1b[2 q");
+			break;
+		default:
+			return ERR;
+	}
+
+	/* Write it out */
+	if (vtwrite() == ERR) return ERR;
+
+	vtvis = visibility;
+
+	return old;
+}
+
+
+/******************************************************************************
+ *
+ * vtend
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Restores the terminal's attributes, line wrapping, cursor
+ *                 and main screen, and then the original console mode.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtend(void)
+{
+	int r;
+
+	/* Undo everything we changed */
+	VTPUTS("\x1b[0m\x1b[?7h\x1b[?25h\x1b[0 q\x1b[?1049l");
+	r = vtwrite();
+
+	/* Restore the console mode and output code page */
+	if (!SetConsoleMode(hstdout, vtmode)) r = ERR;
+	if (vtcp && !SetConsoleOutputCP(vtcp)) r = ERR;
+
+	/* Free our output buffer */
+	free(vtbuf);
+	vtbuf = NULL;
+	vtsize = 0;
+
+	return r;
+}
+
+
+/******************************************************************************
+ *
+ * vtreserve
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Makes room for 'len' more bytes at the end of the virtual
+ *                 terminal backend's output buffer, growing it if necessary.
+ *
+ * RETURN VALUE:   Returns a pointer to the first free byte of the buffer, or
+ *                 NULL if it could not be grown.
+ *
+ * NOTES:          The caller is responsible for adding the bytes it writes to
+ *                 'vtlen'.
+ *
+ *****************************************************************************/
+
+static char *vtreserve(size_t len)
+{
+	char *p;
+	size_t size;
+
+	/* Only reallocate when we need more space than we already have */
+	if (vtlen + len > vtsize) {
+		/* Double the size of the buffer until it is big enough */
+		for (size = vtsize ? vtsize : 4096; size < vtlen + len; size *= 2);
+		p = realloc(vtbuf, size);
+
+		/* Sanity check: successfully allocated memory */
+		if (!p) return NULL;
+
+		vtbuf = p;
+		vtsize = size;
+	}
+
+	return vtbuf + vtlen;
+}
+
+
+/******************************************************************************
+ *
+ * vtput
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the 'len' bytes pointed to by 's' for output by the
+ *                 virtual terminal backend.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtput(const char *s, size_t len)
+{
+	char *p = vtreserve(len);
+
+	/* Sanity check: successfully allocated memory */
+	if (!p) return ERR;
+
+	memcpy(p, s, len);
+	vtlen += len;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtint
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the decimal digits of 'n' (which must not be
+ *                 negative) for output by the virtual terminal backend.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtint(int n)
+{
+	char digits[12];
+	int i = sizeof(digits);
+
+	/* Write the digits backwards from the end of our array */
+	do {
+		digits[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+
+	return vtput(digits + i, sizeof(digits) - i);
+}
+
+
+/******************************************************************************
+ *
+ * vtintlen
+ *
+ ******************************************************************************
+ *
+ * RETURN VALUE:   Returns the number of decimal digits in 'n' (which must not
+ *                 be negative).
+ *
+ *****************************************************************************/
+
+static int vtintlen(int n)
+{
+	int len = 1;
+
+	while (n >= 10) {
+		n /= 10;
+		len++;
+	}
+
+	return len;
+}
+
+
+/******************************************************************************
+ *
+ * vtsgr
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues a select graphic rendition sequence which changes the
+ *                 terminal's attributes from 'vtattr' to the Windows console
+ *                 attributes 'attrs'.
+ *
+ *                 Only the attributes which differ are changed, except that
+ *                 turning off underlining or reverse video requires resetting
+ *                 everything.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtsgr(WORD attrs)
+{
+	/* Maps Windows console color bits (BGR) to terminal color numbers (RGB) */
+	static const char ansi[8] = { '0', '4', '2', '6', '1', '5', '3', '7' };
+	const WORD flagmask = COMMON_LVB_UNDERSCORE | COMMON_LVB_REVERSE_VIDEO;
+	char *p, *start;
+	int reset;
+
+	/* Nothing to do if the attributes are already in effect */
+	if (vtattr == attrs) return OK;
+
+	/* Make room for the longest sequence we could write */
+	start = p = vtreserve(24);
+	if (!p) return ERR;
+
+	/* Unless we know better, start from scratch */
+	reset = vtattr < 0 || (vtattr & ~attrs & flagmask);
+
+	*p++ = '\x1b';
+	*p++ = '[';
+	if (reset) {
+		*p++ = '0';
+		*p++ = ';';
+	}
+
+	/* Turn on underlining and reverse video */
+	if (attrs & COMMON_LVB_UNDERSCORE
+			&& (reset || !(vtattr & COMMON_LVB_UNDERSCORE))) {
+		*p++ = '4';
+		*p++ = ';';
+	}
+	if (attrs & COMMON_LVB_REVERSE_VIDEO
+			&& (reset || !(vtattr & COMMON_LVB_REVERSE_VIDEO))) {
+		*p++ = '7';
+		*p++ = ';';
+	}
+
+	/* Set the foreground color, using the bright colors for intensity */
+	if (reset || (attrs & 0x0f) != (vtattr & 0x0f)) {
+		*p++ = attrs & FOREGROUND_INTENSITY ? '9' : '3';
+		*p++ = ansi[attrs & 0x07];
+		*p++ = ';';
+	}
+
+	/* Set the background color, using the bright colors for intensity */
+	if (reset || (attrs & 0xf0) != (vtattr & 0xf0)) {
+		if (attrs & BACKGROUND_INTENSITY) {
+			*p++ = '1';
+			*p++ = '0';
+		} else *p++ = '4';
+		*p++ = ansi[(attrs >> 4) & 0x07];
+		*p++ = ';';
+	}
+
+	vtattr = attrs;
+
+	/* If only attributes we cannot show have changed, write nothing */
+	if (p - start == 2) return OK;
+
+	/* Finish the sequence by replacing the last separator */
+	p[-1] = 'm';
+	vtlen += p - start;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtmove
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the cheapest sequence which moves the terminal's
+ *                 cursor to ('y', 'x') in the window pointed to by 'win'.
+ *
+ *                 If we know where the cursor is, the cost in bytes of moving
+ *                 it with an absolute position is weighed against moving it
+ *                 relative to where it is, either by rows and columns, with a
+ *                 carriage return and line feed, or by rewriting the cells in
+ *                 between when they already have the right attributes.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtmove(WINDOW *win, int y, int x)
+{
+	int best, cost, how, hbest, hhow, hcost;
+
+	/* Nothing to do if the cursor is already in place */
+	if (vtcur.Y == y && vtcur.X == x) return OK;
+
+	/* Absolute positioning works from anywhere (and the position is optional) */
+	best = 3 + (y || x ? vtintlen(y + 1) : 0) + (x ? 1 + vtintlen(x + 1) : 0);
+	how = WC_MVABS;
+	hbest = WC_MVNONE;
+
+	/* If we know where the cursor is, see if we can do better */
+	if (vtcur.Y >= 0) {
+		/* Move by rows ("ESC [ n A" or "ESC [ n B"), then by columns */
+		cost = y == vtcur.Y ? 0 : 3 + vtintlen(abs(y - vtcur.Y));
+		if (cost < best) {
+			hcost = vtcolcost(win, y, vtcur.X, x, best - cost, &hhow);
+			if (cost + hcost < best) {
+				best = cost + hcost;
+				how = WC_MVREL;
+				hbest = hhow;
+			}
+		}
+
+		/* Move down a row with a carriage return and line feed */
+		if (y == vtcur.Y + 1 && y < win->size.Y) {
+			cost = 2 + vtcolcost(win, y, 0, x, best - 2, &hhow);
+			if (cost < best) {
+				best = cost;
+				how = WC_MVCRLF;
+				hbest = hhow;
+			}
+		}
+	}
+
+	switch (how) {
+		case WC_MVABS:
+			if (VTPUTS("\x1b[") == ERR) return ERR;
+			if ((y || x) && vtint(y + 1) == ERR) return ERR;
+			if (x && (VTPUTS(";") == ERR || vtint(x + 1) == ERR))
+				return ERR;
+			if (VTPUTS("H") == ERR) return ERR;
+			break;
+		case WC_MVREL:
+			if (y != vtcur.Y) {
+				if (VTPUTS("\x1b[") == ERR || vtint(abs(y - vtcur.Y)) == ERR)
+					return ERR;
+				if ((y < vtcur.Y ? VTPUTS("A") : VTPUTS("B")) == ERR)
+					return ERR;
+			}
+			if (vtcolmove(win, y, vtcur.X, x, hbest) == ERR)
+				return ERR;
+			break;
+		case WC_MVCRLF:
+			if (VTPUTS("\r\n") == ERR) return ERR;
+			if (vtcolmove(win, y, 0, x, hbest) == ERR)
+				return ERR;
+			break;
+	}
+
+	vtcur.Y = y;
+	vtcur.X = x;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * vtcolcost
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Works out the cheapest way to move the terminal's cursor
+ *                 from column 'from' to column 'x' on row 'y' of the window
+ *                 pointed to by 'win', saving it to 'how' as one of the
+ *                 WC_MV* column movements.
+ *
+ *                 Rewriting the cells in between is only considered if it
+ *                 would cost less than 'limit' bytes.
+ *
+ * RETURN VALUE:   Returns the cost of the movement in bytes.
+ *
+ *****************************************************************************/
+
+static int vtcolcost(WINDOW *win, int y, int from, int x, int limit, int *how)
+{
+	CHAR_INFO *c;
+	int best, cost, i;
+
+	/* Nothing to do if we are already there */
+	if (from == x) {
+		*how = WC_MVNONE;
+		return 0;
+	}
+
+	/* A carriage return gets us to the first column */
+	if (x == 0) {
+		*how = WC_MVCR;
+		return 1;
+	}
+
+	/* Move to an absolute column */
+	best = 3 + vtintlen(x + 1);
+	*how = WC_MVCOL;
+
+	/* Move forward or backward (where a count of one is optional) */
+	cost = 3 + (abs(x - from) > 1 ? vtintlen(abs(x - from)) : 0);
+	if (cost < best) {
+		best = cost;
+		*how = x > from ? WC_MVFWD : WC_MVBACK;
+	}
+
+	/* Return to the first column and move forward */
+	cost = 4 + (x > 1 ? vtintlen(x) : 0);
+	if (cost < best) {
+		best = cost;
+		*how = WC_MVCRFWD;
+	}
+
+	/*
+	 * Rewrite the cells in between, which costs a byte each, as long as they
+	 * are plain characters with the attributes already in effect.
+	 */
+	if (x > from && x - from < best && x - from < limit) {
+		c = win->line[y];
+		for (i = from; i < x; i++)
+			if (c[i].Attributes != vtattr
+					|| c[i].Char.UnicodeChar < ' '
+					|| c[i].Char.UnicodeChar >= 0x7f)
+				break;
+		if (i == x) {
+			best = x - from;
+			*how = WC_MVREWRITE;
+		}
+	}
+
+	return best;
+}
+
+
+/******************************************************************************
+ *
+ * vtcolmove
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Queues the column movement 'how' (as worked out by
+ *                 'vtcolcost') from column 'from' to column 'x' on row 'y' of
+ *                 the window pointed to by 'win'.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtcolmove(WINDOW *win, int y, int from, int x, int how)
+{
+	char *p;
+	int i;
+
+	switch (how) {
+		case WC_MVNONE:
+			return OK;
+		case WC_MVCR:
+			return VTPUTS("\r");
+		case WC_MVCOL:
+			if (VTPUTS("\x1b[") == ERR || vtint(x + 1) == ERR) return ERR;
+			return VTPUTS("G");
+		case WC_MVFWD:
+		case WC_MVBACK:
+			if (VTPUTS("\x1b[") == ERR) return ERR;
+			if (abs(x - from) > 1 && vtint(abs(x - from)) == ERR) return ERR;
+			return how == WC_MVFWD ? VTPUTS("C") : VTPUTS("D");
+		case WC_MVCRFWD:
+			if (VTPUTS("\r\x1b[") == ERR) return ERR;
+			if (x > 1 && vtint(x) == ERR) return ERR;
+			return VTPUTS("C");
+		case WC_MVREWRITE:
+			p = vtreserve(x - from);
+			if (!p) return ERR;
+			for (i = from; i < x; i++)
+				*p++ = (char)win->line[y][i].Char.UnicodeChar;
+			vtlen += x - from;
+			return OK;
+	}
+
+	return ERR;
+}
+
+
+/******************************************************************************
+ *
+ * vtwrite
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Writes out and empties the virtual terminal backend's output
+ *                 buffer.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int vtwrite(void)
+{
+	DWORD len, done = 0;
+
+	/* Keep writing until everything has been written */
+	while (done < vtlen) {
+		if (!WriteFile(hstdout, vtbuf + done, vtlen - done, &len, NULL)) {
+			vtlen = 0;
+			return ERR;
+		}
+		concalls++;
+		WC_COUNT(files, 1);
+		WC_COUNT(bytes, len);
+		done += len;
+	}
+
+	vtlen = 0;
+
+	return OK;
+}
+
+/******************************************************************************
+ *
+ * meminit
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets up the memory backend with a blank screen the size of
+ *                 'stdscr', an empty input queue, and an event to stand in
+ *                 for the console input handle (see 'wc_inputhandle').
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int meminit(void)
+{
+	int i;
+
+	/* Allocate the screen and clear it */
+	memsize = tocoord(stdscr->size);
+	memwin = memsize;
+	memcells = malloc(sizeof(CHAR_INFO) * memsize.Y * memsize.X);
+	if (!memcells) return ERR;
+	for (i = 0; i < memsize.Y * memsize.X; i++) {
+		memcells[i].Char.UnicodeChar = WC_BGND;
+		memcells[i].Attributes = stdscr->attrs;
+	}
+
+	/* The cursor starts out in the upper left corner, normally visible */
+	memcur.Y = memcur.X = 0;
+	memvis = 1;
+
+	/* Nothing is queued yet, so the event starts out reset */
+	memhead = meminlen = 0;
+	hstdin = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (!hstdin) return ERR;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memscroll
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Scrolls the rows from 'top' to 'bot', inclusive, of the
+ *                 memory backend's screen up by 'n' rows, or down if 'n' is
+ *                 negative. The exposed rows are filled with the background
+ *                 character, like 'conshift' does.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int memscroll(int top, int bot, int n)
+{
+	CHAR_INFO *exposed;
+	int w = memsize.X, moved = bot - top + 1 - abs(n), i;
+
+	/* Sanity check: within the screen? */
+	if (top < 0 || bot >= memsize.Y || moved < 0) return ERR;
+
+	/* Move the rows which stay within the region */
+	if (n > 0) {
+		memmove(memcells + top * w, memcells + (top + n) * w,
+				sizeof(CHAR_INFO) * moved * w);
+		exposed = memcells + (top + moved) * w;
+	}
+	else {
+		memmove(memcells + (top - n) * w, memcells + top * w,
+				sizeof(CHAR_INFO) * moved * w);
+		exposed = memcells + top * w;
+	}
+
+	/* Fill the exposed rows */
+	for (i = 0; i < abs(n) * w; i++) {
+		exposed[i].Char.UnicodeChar = WC_BGND;
+		exposed[i].Attributes = curscr->attrs;
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memflush
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Copies the 'n' spans of cells in the 'spans' array from the
+ *                 window pointed to by 'win' onto the memory backend's screen
+ *                 and moves its cursor.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int memflush(WINDOW *win, SMALL_RECT *spans, int n)
+{
+	int i, y;
+
+	for (i = 0; i < n; i++)
+		for (y = spans[i].Top; y <= spans[i].Bottom; y++)
+			memcpy(memcells + y * memsize.X + spans[i].Left,
+					win->line[y] + spans[i].Left,
+					sizeof(CHAR_INFO) * (spans[i].Right - spans[i].Left + 1));
+
+	memcur = tocoord(win->cur);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memresize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Resizes the memory backend's screen to 'lines' rows by
+ *                 'cols' columns, keeping the cells which are on both the old
+ *                 and the new screen and clearing the rest.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int memresize(int lines, int cols)
+{
+	CHAR_INFO *cells;
+	int y, x;
+
+	cells = malloc(sizeof(CHAR_INFO) * lines * cols);
+	if (!cells) return ERR;
+
+	for (y = 0; y < lines; y++)
+		for (x = 0; x < cols; x++) {
+			if (y < memsize.Y && x < memsize.X)
+				cells[y * cols + x] = memcells[y * memsize.X + x];
+			else {
+				cells[y * cols + x].Char.UnicodeChar = WC_BGND;
+				cells[y * cols + x].Attributes = curscr->attrs;
+			}
+		}
+
+	free(memcells);
+	memcells = cells;
+	memsize.Y = (SHORT)lines;
+	memsize.X = (SHORT)cols;
+
+	/* The window is now this size too (see 'checksize') */
+	memwin = memsize;
+
+	/* Keep the cursor on the screen */
+	if (memcur.Y >= lines) memcur.Y = (SHORT)(lines - 1);
+	if (memcur.X >= cols) memcur.X = (SHORT)(cols - 1);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memcurs
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the visibility of the memory backend's cursor.
+ *
+ *                 (See 'curs_set' for more information.)
+ *
+ * RETURN VALUE:   Returns the previous cursor visibility if it was set
+ *                 correctly. Otherwise ERR is returned.
+ *
+ *****************************************************************************/
+
+static int memcurs(int visibility)
+{
+	int old = memvis;
+
+	/* Sanity check: known visibility? */
+	if (visibility < 0 || visibility > 2) return ERR;
+
+	memvis = visibility;
+
+	return old;
+}
+
+
+/******************************************************************************
+ *
+ * memread
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Takes up to 'len' records queued with 'wc_meminput' into
+ *                 the array pointed to by 'recs', and stores how many were
+ *                 taken in 'n'. Size change records set the size of the
+ *                 memory backend's window as they are taken.
+ *
+ * RETURN VALUE:   Returns OK on success. If 'wait' is 'TRUE' and nothing is
+ *                 queued, ERR is returned (since nothing else can arrive).
+ *
+ *****************************************************************************/
+
+static int memread(INPUT_RECORD *recs, DWORD len, DWORD *n, bool wait)
+{
+	DWORD i;
+
+	/* Another thread may be queueing records */
+	EnterCriticalSection(&scrlock);
+
+	/* Nothing will ever arrive once the queue has run out */
+	if (!meminlen) {
+		LeaveCriticalSection(&scrlock);
+		*n = 0;
+		return wait ? ERR : OK;
+	}
+
+	*n = meminlen < len ? (DWORD)meminlen : len;
+	memcpy(recs, memin + memhead, sizeof(INPUT_RECORD) * *n);
+	memhead += *n;
+	meminlen -= *n;
+
+	/* The window takes on its new size as soon as the change is read */
+	for (i = 0; i < *n; i++)
+		if (recs[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
+			memwin = recs[i].Event.WindowBufferSizeEvent.dwSize;
+
+	/* Once everything has been read, start the queue over */
+	if (!meminlen) {
+		memhead = 0;
+		ResetEvent(hstdin);
+	}
+
+	LeaveCriticalSection(&scrlock);
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memwinsize
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Stores the number of rows and columns of the memory
+ *                 backend's window in 'lines' and 'cols'.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ * NOTES:          This function always succeeds.
+ *
+ *****************************************************************************/
+
+static int memwinsize(int *lines, int *cols)
+{
+	*lines = memwin.Y;
+	*cols = memwin.X;
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * memend
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Frees the memory backend's screen and input queue, and
+ *                 closes its input event.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ *****************************************************************************/
+
+static int memend(void)
+{
+	free(memcells);
+	memcells = NULL;
+	free(memin);
+	memin = NULL;
+	memhead = meminlen = meminsize = 0;
+
+	return CloseHandle(hstdin) ? OK : ERR;
+}
+
+
+
+/******************************************************************************
+ * Windows-specific helper function declarations follow.
+ *****************************************************************************/
+
+
+/******************************************************************************
+ *
+ * cls
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears the console screen buffer pointed to by 'hcon' by
+ *                 filling it with the character 'WC_BGND'.
+ *
+ *****************************************************************************/
+
+static void cls(HANDLE hcon)
+{
+	CONSOLE_SCREEN_BUFFER_INFO coninfo;
+	COORD orig;
+	DWORD len, size;
+
+	/* Get console information */
+	GetConsoleScreenBufferInfo(hcon, &coninfo);
+
+	/* Calculate the number of spaces to fill ('size') */
+	size = coninfo.dwSize.Y * coninfo.dwSize.X;
+
+	/* We want to start at (0, 0) */
+	orig.Y = orig.X = 0;
+
+	/*
+	 * Now fill 'size' characters with WG_BGND (defined in wincurses.h)
+	 * starting at 'orig'.
+	 */
+	FillConsoleOutputCharacterW(hcon, WC_BGND, size, orig, &len);
+}
+
+
+/******************************************************************************
+ *
+ * setmode
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Sets the particular console mode specified by the bitmask
+ *                 on the console with handle specified by 'hcon'.
+ *
+ * RETURN VALUE:   Returns OK if the mode was successfully set. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+static int setmode(HANDLE hcon, DWORD bmask)
+{
+	DWORD mode;
+
+	/* The memory backend has no console modes to change */
+	if (output == &memoutput) return OK;
+
+	/* Get the current console mode */
+	if (!GetConsoleMode(hcon, &mode))
+		/* Return ERR on error */
+		return ERR;
+
+	/* Apply the bit mask */
+	mode |= bmask;
+
+	/* Set the new console mode and return its status */
+	return SetConsoleMode(hcon, mode) ? OK : ERR;
+}
+
+
+/******************************************************************************
+ *
+ * clearmode
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Clears the particular console mode specified by the bitmask
+ *                 on the console with handle specified by 'hcon'.
+ *
+ * RETURN VALUE:   Returns OK if the mode was successfully set. Otherwise, ERR
+ *                 is returned.
+ *
+ *****************************************************************************/
+
+static int clearmode(HANDLE hcon, DWORD bmask)
+{
+	DWORD mode;
+
+	/* The memory backend has no console modes to change */
+	if (output == &memoutput) return OK;
+
+	/* Get the current console mode */
+	if (!GetConsoleMode(hcon, &mode))
+		/* Return ERR on error */
+		return ERR;
+
+	/* Apply the bit mask */
+	mode &= ~bmask;
+
+	/* Set the new console mode and return its status */
+	return SetConsoleMode(hcon, mode) ? OK : ERR;
+}
+
+
+/******************************************************************************
+ *
+ * va_wprintw
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Helper function to aid the *printw functions in their tasks
+ *                 by printing from a va_list 'list' using a specified format,
+ *                 'fmt' in the window pointed to by 'win'.
+ *
+ *                 Text between conversions, and strings converted without
+ *                 flags or a width, are written straight into the window (see
+ *                 'putstr'). Every other conversion is formatted into a small
+ *                 buffer on the stack, or into the scratch memory if it is too
+ *                 long for that, and then written.
+ *
+ * RETURN VALUE:   Returns the number of characters placed in the window, or a
+ *                 negative number if 'fmt' is invalid or the scratch memory
+ *                 could not be grown.
+ *
+ * NOTES:          Printing stops as soon as the cursor runs off the bottom of
+ *                 the window, without formatting the rest of the conversions.
+ *                 A conversion is never formatted past the room left in the
+ *                 window.
+ *
+ *                 '%n' stores the number of characters placed so far, and is
+ *                 ignored if it has flags, a width or length modifiers.
+ *
+ *****************************************************************************/
+
+static int va_wprintw(WINDOW *win, char *fmt, va_list *args)
+{
+	char spec[WC_SPECLEN], buf[WC_FMTBUF], *out;
+	const char *f = fmt;
+	wcarg_t arg;
+	size_t room;
+	bool locked;
+	int count = 0, len, r;
+
+	while (*f) {
+		/* Write the text up to the next conversion straight into the window */
+		for (len = 0; f[len] && f[len] != '%'; len++);
+		if (len && putstr(win, f, len, &count) == ERR) return count;
+		f += len;
+		if (!*f) break;
+		f++;
+
+		/* A percent sign on its own */
+		if (*f == '%') {
+			if (putstr(win, f, 1, &count) == ERR) return count;
+			f++;
+			continue;
+		}
+
+		/* Parse the conversion and take its argument */
+		if (parsespec(&f, spec, args, &arg) == ERR) return -1;
+
+		/* Conversions which are not formatted */
+		if (arg.conv == 'n') {
+			if (arg.plain) *(int *)arg.v.p = count;
+			continue;
+		}
+		if (arg.conv == 's' && arg.plain) {
+			if (putstr(win, arg.v.p ? arg.v.p : "(null)", arg.prec, &count)
+					== ERR)
+				return count;
+			continue;
+		}
+
+		/*
+		 * Find how much room is left in the window. (A window which scrolls
+		 * can take a screenful.)
+		 */
+		if (win->cur.Y >= win->size.Y) return count;
+		room = win->flags & WC_SCROLLOK
+				? (size_t)win->size.Y * win->size.X
+				: (size_t)(win->size.Y - win->cur.Y) * win->size.X
+						- win->cur.X;
+
+		/*
+		 * Format the conversion into our buffer, and again into the scratch
+		 * memory if it was cut short and more of it would fit (at up to three
+		 * bytes a character, when encoded as UTF-8). The scratch memory is
+		 * shared by every thread, so hold the screen lock until it is written.
+		 */
+		out = buf;
+		len = fmtarg(out, sizeof(buf), spec, &arg);
+		locked = len < 0 && room * 3 + 1 > sizeof(buf);
+		if (locked) {
+			EnterCriticalSection(&scrlock);
+			out = getscratch(room * 3 + 1);
+			if (!out) {
+				LeaveCriticalSection(&scrlock);
+				return -1;
+			}
+			len = fmtarg(out, room * 3 + 1, spec, &arg);
+		}
+
+		/* Write whatever was formatted */
+		if (len < 0) len = (int)strlen(out);
+		r = putstr(win, out, len, &count);
+		if (locked) LeaveCriticalSection(&scrlock);
+		if (r == ERR) return count;
+	}
+
+	return count;
+}
+
+
+/******************************************************************************
+ *
+ * parsespec
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Parses the 'printw' conversion specification following a
+ *                 percent sign at '*fmt', copies it into the buffer 'spec'
+ *                 (which holds 'WC_SPECLEN' bytes) and takes its argument from
+ *                 'args', filling in the conversion pointed to by 'arg'.
+ *                 '*fmt' is left just past the specification.
+ *
+ *                 A width or precision given as '*' is taken from 'args' and
+ *                 written into 'spec', so that 'spec' can be formatted with the
+ *                 conversion's argument alone (see 'fmtarg').
+ *
+ * RETURN VALUE:   Returns OK on success or ERR if the specification is
+ *                 invalid.
+ *
+ * NOTES:          Repeated flags are only copied once, and widths and
+ *                 precisions are limited to six digits, so that 'spec' cannot
+ *                 overflow.
+ *
+ *****************************************************************************/
+
+static int parsespec(const char **fmt, char *spec, va_list *args, wcarg_t *arg)
+{
+	const char *f = *fmt;
+	char *p = spec;
+	int type = WC_ARGINT, n;
+	bool ldbl = FALSE;
+
+	*p++ = '%';
+	arg->prec = -1;
+	arg->plain = TRUE;
+
+	/* Flags, each copied once */
+	while (*f && strchr("-+ #0", *f)) {
+		if (!memchr(spec, *f, p - spec)) *p++ = *f;
+		arg->plain = FALSE;
+		f++;
+	}
+
+	/* Width, which may be taken from the arguments */
+	if (*f == '*' || (*f >= '0' && *f <= '9')) {
+		if (*f == '*') {
+			n = va_arg(*args, int);
+			f++;
+		} else {
+			for (n = 0; *f >= '0' && *f <= '9'; f++)
+				if (n < 100000) n = n * 10 + *f - '0';
+		}
+		if (n > 999999) n = 999999;
+		if (n < -999999) n = -999999;
+		p += _snprintf_s(p, spec + WC_SPECLEN - p, _TRUNCATE, "%d", n);
+		arg->plain = FALSE;
+	}
+
+	/* Precision, which may also be taken from the arguments */
+	if (*f == '.') {
+		f++;
+		if (*f == '*') {
+			n = va_arg(*args, int);
+			f++;
+		} else {
+			for (n = 0; *f >= '0' && *f <= '9'; f++)
+				if (n < 100000) n = n * 10 + *f - '0';
+		}
+		if (n > 999999) n = 999999;
+
+		/* A negative precision is taken as if it were left out */
+		if (n >= 0) {
+			arg->prec = n;
+			p += _snprintf_s(p, spec + WC_SPECLEN - p, _TRUNCATE, ".%d", n);
+		}
+	}
+
+	/* Length modifiers (including Microsoft's) */
+	for (;;) {
+		if (*f == 'h') {
+			*p++ = *f++;
+		} else if (*f == 'l') {
+			type = type == WC_ARGLONG ? WC_ARGLLONG : WC_ARGLONG;
+			*p++ = *f++;
+		} else if (*f == 'L') {
+			ldbl = TRUE;
+			*p++ = *f++;
+		} else if (*f == 'j' || (f[0] == 'I' && f[1] == '6' && f[2] == '4')) {
+			type = WC_ARGLLONG;
+			if (*f == 'I') {
+				*p++ = *f++;
+				*p++ = *f++;
+			}
+			*p++ = *f++;
+		} else if (f[0] == 'I' && f[1] == '3' && f[2] == '2') {
+			type = WC_ARGINT;
+			*p++ = *f++;
+			*p++ = *f++;
+			*p++ = *f++;
+		} else if (*f == 'z' || *f == 't' || *f == 'I') {
+			type = WC_ARGSIZE;
+			*p++ = *f++;
+		} else if (*f == 'w') {
+			*p++ = *f++;
+		} else {
+			break;
+		}
+
+		/* Make sure the modifiers cannot overflow 'spec' */
+		if (p - spec > WC_SPECLEN - 8) return ERR;
+		arg->plain = arg->plain && p[-1] == 'h';
+	}
+
+	/* The conversion decides the type of the argument */
+	switch (*f) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			break;
+		case 'c': case 'C':
+			type = WC_ARGINT;
+			break;
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			type = ldbl ? WC_ARGLDBL : WC_ARGDBL;
+			break;
+		case 's': case 'p': case 'n':
+			type = WC_ARGPTR;
+			break;
+		case 'S':
+			/* Microsoft's wide string, which is never written as-is */
+			arg->plain = FALSE;
+			type = WC_ARGPTR;
+			break;
+		default:
+			return ERR;
+	}
+	arg->conv = *f;
+	arg->type = type;
+	*p++ = *f++;
+	*p = '\0';
+	*fmt = f;
+
+	/* Take the argument */
+	switch (type) {
+		case WC_ARGINT:
+			arg->v.i = va_arg(*args, int);
+			break;
+		case WC_ARGLONG:
+			arg->v.l = va_arg(*args, long);
+			break;
+		case WC_ARGLLONG:
+			arg->v.ll = va_arg(*args, LONGLONG);
+			break;
+		case WC_ARGSIZE:
+			arg->v.z = va_arg(*args, SIZE_T);
+			break;
+		case WC_ARGDBL:
+			arg->v.d = va_arg(*args, double);
+			break;
+		case WC_ARGLDBL:
+			arg->v.ld = va_arg(*args, long double);
+			break;
+		default:
+			arg->v.p = va_arg(*args, void *);
+	}
+
+	return OK;
+}
+
+
+/******************************************************************************
+ *
+ * fmtarg
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Formats the argument of the conversion pointed to by 'arg'
+ *                 into the buffer 'buf' of 'size' bytes, according to the
+ *                 conversion specification 'spec' (see 'parsespec').
+ *
+ * RETURN VALUE:   Returns the number of bytes formatted, or a negative number
+ *                 if the result was cut short to fit in 'buf' (or could not be
+ *                 formatted at all).
+ *
+ *****************************************************************************/
+
+static int fmtarg(char *buf, size_t size, const char *spec, wcarg_t *arg)
+{
+	/* Leave the buffer empty if the conversion fails */
+	buf[0] = '\0';
+
+	switch (arg->type) {
+		case WC_ARGINT:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.i);
+		case WC_ARGLONG:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.l);
+		case WC_ARGLLONG:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.ll);
+		case WC_ARGSIZE:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.z);
+		case WC_ARGDBL:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.d);
+		case WC_ARGLDBL:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.ld);
+		default:
+			return _snprintf_s(buf, size, _TRUNCATE, spec, arg->v.p);
+	}
+}
+
+
+/******************************************************************************
+ *
+ * getattrs
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Translates 'attrs' into a Windows-specific console display
+ *                 attributes bit mask.
+ *
+ * RETURN VALUE:   Returns a bitmask representing Windows-specific console
+ *                 display attributes.
+ *
+ * NOTES:          The color flags of each color pair are kept in 'pairattrs',
+ *                 so colors cost a single lookup. They are only included if
+ *                 'attrs' carries a color pair, so that attributes without
+ *                 one leave the colors they are combined with alone.
+ *
+ *****************************************************************************/
+
+static WORD getattrs(unsigned int attrs)
+{
+	WORD bmask = 0;
+
+	/* Set up our bit mask */
+	if (attrs & A_BOLD)      bmask |= FOREGROUND_INTENSITY;
+	if (attrs & A_REVERSE)   bmask |= COMMON_LVB_REVERSE_VIDEO;
+	if (attrs & A_STANDOUT)  bmask |= BACKGROUND_INTENSITY;
+	if (attrs & A_UNDERLINE) bmask |= COMMON_LVB_UNDERSCORE;
+
+	/* Apply the color pair's console flags */
+	if (flags & WC_COLOR && attrs & A_COLOR)
+		bmask |= pairattrs[A_COLOR_DATA(attrs) & (MAX_NUM_PAIRS - 1)];
+
+	return bmask;
+}
+
+
+/******************************************************************************
+ *
+ * cellattrs
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Works out the Windows-specific console display attributes
+ *                 of a cell written to the window pointed to by 'win' with
+ *                 the character 'ch'.
+ *
+ *                 The attributes carried by 'ch' are added to the window's,
+ *                 and if 'ch' carries a color pair (and colors are on), it
+ *                 replaces the window's colors.
+ *
+ * RETURN VALUE:   Returns a bitmask representing Windows-specific console
+ *                 display attributes.
+ *
+ *****************************************************************************/
+
+static WORD cellattrs(WINDOW *win, chtype ch)
+{
+	WORD a = win->attrs;
+
+	/* Most characters carry no attributes of their own */
+	if (!(ch & A_ATTRIBUTES)) return a;
+
+	if (ch & A_COLOR && flags & WC_COLOR) a &= ~WC_COLORFLAGS;
+
+	return a | getattrs(ch & A_ATTRIBUTES);
+}
+
+
+/******************************************************************************
+ *
+ * pairmask
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Works out the console color flags for the foreground and
+ *                 background colors of color pair 'pair' (see 'pairattrs').
+ *
+ * RETURN VALUE:   Returns a bitmask of Windows-specific console color flags.
+ *
+ * NOTES:          The current implementation uses Windows console bit masks to
+ *                 represent colors. Presumably, any ARGB color combination can
+ *                 be represented and implemented under the current design.
  *
  *****************************************************************************/
 
-int attroff(int attrs)
+static WORD pairmask(short pair)
 {
-	return wattroff(stdscr, attrs);
+	color_t *f = &colors[color_pairs[pair].f];
+	color_t *b = &colors[color_pairs[pair].b];
+	WORD bmask, colormask;
+
+	/* TODO: Add support for custom colors */
+	/* Colors are only applied using console flags if we cannot change them */
+	if (can_change_color() == TRUE) return 0;
+
+	bmask = (f->r == 0 ? 0 : FOREGROUND_RED)
+			| (f->g == 0 ? 0 : FOREGROUND_GREEN)
+			| (f->b == 0 ? 0 : FOREGROUND_BLUE);
+
+	/*
+	 * We use the 'FTOB' macro to derive the Windows console background color
+	 * flag from a Windows console foreground flag. (It's just a bit shift.)
+	 */
+	colormask = (b->r == 0 ? 0 : FOREGROUND_RED)
+			| (b->g == 0 ? 0 : FOREGROUND_GREEN)
+			| (b->b == 0 ? 0 : FOREGROUND_BLUE);
+	bmask |= FTOB(colormask);
+
+	return bmask;
 }
 
 
 /******************************************************************************
  *
- * attrset
+ * putcell
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables ONLY the attributes specified by the 'attrs' bit map
- *                 in 'stdscr'.
- *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ * DESCRIPTION:    Writes the wide character 'wc' with the console display
+ *                 attributes 'attrs' to the cell of 'win' at the current cursor
+ *                 location and advances the cursor, wrapping to a new line at
+ *                 the end of the row.
  *
- * NOTES:          This function always succeeds.
+ * RETURN VALUE:   Returns OK if the character was successfully written.
+ *                 Otherwise, ERR is returned.
  *
  *****************************************************************************/
 
-int attrset(int attrs)
+static int putcell(WINDOW *win, WCHAR wc, WORD attrs)
 {
-	return wattrset(stdscr, attrs);
+	CHAR_INFO *c;
+
+	/* Sanity check: the cursor has not run off the bottom */
+	if (win->cur.Y >= win->size.Y) return ERR;
+
+	/* Write the character information to our cells with formatting */
+	if (markdirty(win, win->cur.Y, win->cur.X, win->cur.X) == ERR)
+		return ERR;
+	c = &win->line[win->cur.Y][win->cur.X];
+	c->Char.UnicodeChar = wc;
+	c->Attributes = attrs;
+
+	/* Advance the cursor */
+	win->cur.X = (win->cur.X + 1) % win->size.X;
+
+	/* Check for line wrap */
+	if (!win->cur.X && newline(win) == ERR) return ERR;
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * wattron
+ * putstr
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables the attributes specified by the 'attrs' bit map in
- *                 the window pointed to by 'win'.
+ * DESCRIPTION:    Adds at most 'n' bytes of the UTF-8 string 'str' to 'win'
+ *                 starting at the current cursor location, or the whole string
+ *                 if 'n' is negative, and adds the number of characters placed
+ *                 to the count pointed to by 'count', if it is not NULL.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *                 Ordinary characters are decoded straight into the window a
+ *                 row at a time (see 'utf8dec'), so wrapping is only handled
+ *                 once per row.
  *
- * NOTES:          This function always succeeds.
+ * RETURN VALUE:   Returns OK if the whole string was successfully written.
+ *                 Otherwise, ERR is returned.
+ *
+ * NOTES:          Plain ASCII is copied eight characters at a time, checking
+ *                 all eight bytes for anything that needs decoding with a
+ *                 single 64-bit test.
  *
  *****************************************************************************/
 
-int wattron(WINDOW *win, int attrs)
+static int putstr(WINDOW *win, const char *str, int n, int *count)
 {
-	/* Set up our bit mask */
-	WORD bmask = getattrs(attrs);
+	CHAR_INFO *c;
+	const char *end;
+	ULONGLONG v;
+	WCHAR wc;
+	int room, len, i;
 
-	/* Set our bit mask */
-	win->attrs |= bmask;
+	/* Sanity check: NULL pointers */
+	if (!win || !str) return ERR;
+
+	/*
+	 * A negative count means the whole string. Otherwise, stop at the end of
+	 * the string if it comes first, so that we never read beyond it.
+	 */
+	if (n < 0) {
+		n = (int)strlen(str);
+	} else if ((end = memchr(str, '\0', n)) != NULL) {
+		n = (int)(end - str);
+	}
+
+	while (n > 0 && *str) {
+		/* Leave special characters to waddch */
+		if (*str == '\r' || *str == '\n') {
+			if (waddch(win, (unsigned char)*str) == ERR) return ERR;
+			if (count) (*count)++;
+			str++;
+			n--;
+			continue;
+		}
+
+		/* Sanity check: the cursor has not run off the bottom */
+		if (win->cur.Y >= win->size.Y) return ERR;
+
+		/* Make sure the row is ours to write to (see 'ownrow') */
+		if (ownrow(win, win->cur.Y) == ERR) return ERR;
+
+		/* Decode the run of ordinary characters which fits on this row */
+		c = &win->line[win->cur.Y][win->cur.X];
+		room = win->size.X - win->cur.X;
+		len = 0;
+		while (len < room && n > 0) {
+			/* Copy eight bytes at once if they are all printable ASCII */
+			if (n >= 8 && room - len >= 8) {
+				memcpy(&v, str, sizeof(v));
+				if (!((v | ((v - WC_ONES * ' ') & ~v)) & (WC_ONES * 0x80))) {
+					for (i = 0; i < 8; i++) {
+						c[len + i].Char.UnicodeChar = (unsigned char)str[i];
+						c[len + i].Attributes = win->attrs;
+					}
+					len += 8;
+					str += 8;
+					n -= 8;
+					continue;
+				}
+			}
+
+			/* Stop at a special character */
+			if (*str == '\r' || *str == '\n') break;
+
+			/* Decode a single character, which may take several bytes */
+			i = utf8dec(str, n, &wc);
+			c[len].Char.UnicodeChar = wc;
+			c[len].Attributes = win->attrs;
+			len++;
+			str += i;
+			n -= i;
+		}
+
+		/* Mark the whole run as changed */
+		if (markdirty(win, win->cur.Y, win->cur.X, win->cur.X + len - 1)
+				== ERR)
+			return ERR;
+		if (count) *count += len;
+
+		/* Advance the cursor, wrapping if we reached the end of the row */
+		win->cur.X += len;
+		if (win->cur.X == win->size.X) {
+			win->cur.X = 0;
+			if (newline(win) == ERR) return ERR;
+		}
+	}
 
 	return OK;
 }
@@ -638,353 +7070,456 @@ int wattron(WINDOW *win, int attrs)
 
 /******************************************************************************
  *
- * wattroff
+ * utf8dec
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Disables the attributes specified by the 'attrs' bit map in
- *                 the window pointed to by 'win'.
+ * DESCRIPTION:    Decodes the UTF-8 sequence at the start of the string 's',
+ *                 which has 'n' bytes left, into the wide character pointed to
+ *                 by 'wc'.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns the number of bytes decoded, which is at least one
+ *                 when 'n' is positive.
  *
- * NOTES:          This function always succeeds.
+ * NOTES:          Invalid, truncated and overlong sequences, encoded surrogates
+ *                 and characters beyond the Basic Multilingual Plane (which do
+ *                 not fit in a console cell) are decoded as 'WC_BADCHAR'. A bad
+ *                 sequence only consumes the bytes up to where it went wrong,
+ *                 so the next character is not lost.
  *
  *****************************************************************************/
 
-int wattroff(WINDOW *win, int attrs)
+static int utf8dec(const char *s, int n, WCHAR *wc)
 {
-	/* Set up our bit mask */
-	WORD bmask = getattrs(attrs);
+	const unsigned char *u = (const unsigned char *)s;
+	DWORD cp;
+	int len, i;
+
+	/* Work out the length of the sequence from its first byte */
+	if (u[0] < 0x80) {
+		*wc = u[0];
+		return 1;
+	} else if (u[0] >= 0xc2 && u[0] < 0xe0) {
+		len = 2;
+		cp = u[0] & 0x1f;
+	} else if (u[0] >= 0xe0 && u[0] < 0xf0) {
+		len = 3;
+		cp = u[0] & 0x0f;
+	} else if (u[0] >= 0xf0 && u[0] < 0xf5) {
+		len = 4;
+		cp = u[0] & 0x07;
+	} else {
+		/* A stray continuation byte or one which never appears in UTF-8 */
+		*wc = WC_BADCHAR;
+		return 1;
+	}
 
-	/* Clear our bit mask */
-	win->attrs &= ~bmask;
+	/* Collect the bits of each continuation byte */
+	for (i = 1; i < len; i++) {
+		if (i >= n || (u[i] & 0xc0) != 0x80) {
+			*wc = WC_BADCHAR;
+			return i;
+		}
+		cp = (cp << 6) | (u[i] & 0x3f);
+	}
 
-	return OK;
+	/* Refuse anything which cannot be stored in a single cell */
+	if (len == 4 || (len == 3 && cp < 0x800) || (cp >= 0xd800 && cp < 0xe000))
+		*wc = WC_BADCHAR;
+	else
+		*wc = (WCHAR)cp;
+
+	return len;
 }
 
 
 /******************************************************************************
  *
- * wattrset
+ * utf8enc
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables ONLY the attributes specified by the 'attrs' bit map
- *                 in the window pointed to by 'win'.
+ * DESCRIPTION:    Encodes the wide character 'wc' as UTF-8 into the buffer
+ *                 pointed to by 's', which must have room for three bytes.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns the number of bytes written.
  *
- * NOTES:          This function always succeeds.
+ * NOTES:          Surrogates are encoded as 'WC_BADCHAR', since they are not
+ *                 characters on their own.
  *
  *****************************************************************************/
 
-int wattrset(WINDOW *win, int attrs)
+static int utf8enc(WCHAR wc, char *s)
 {
-	/* Set up our bit mask */
-	WORD bmask = getattrs(attrs);
-
-	/* Assign our bit mask */
-	win->attrs = bmask;
+	/* Surrogates cannot be encoded on their own */
+	if (wc >= 0xd800 && wc < 0xe000) wc = WC_BADCHAR;
+
+	if (wc < 0x80) {
+		s[0] = (char)wc;
+		return 1;
+	} else if (wc < 0x800) {
+		s[0] = (char)(0xc0 | (wc >> 6));
+		s[1] = (char)(0x80 | (wc & 0x3f));
+		return 2;
+	}
 
-	return OK;
+	s[0] = (char)(0xe0 | (wc >> 12));
+	s[1] = (char)(0x80 | ((wc >> 6) & 0x3f));
+	s[2] = (char)(0x80 | (wc & 0x3f));
+	return 3;
 }
 
 
 /******************************************************************************
  *
- * getch
+ * initcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Reads a single character from 'stdscr'.
+ * DESCRIPTION:    Allocates the cells of the window pointed to by 'win'
+ *                 according to its size and fills them with the character
+ *                 'WC_BGND' using the window's current attributes. Every row
+ *                 starts out marked as changed so that the first refresh
+ *                 paints the whole window, and without a hash.
  *
- *                 (See 'wgetch' for more information.)
+ *                 If the window is a subwindow, no cells are allocated and
+ *                 its rows point into the cells of its parent instead. (The
+ *                 rows it shares with a pad are given cells of their own
+ *                 first, so that they never move.)
  *
- * RETURN VALUE:   Returns the character read or one of several KEY_*
- *                 constants (if the 'keypad' flag is set).
+ *                 If the window is a pad, only one chunk of blank rows is
+ *                 allocated, which every row starts out pointing into.
  *
- *                 (See 'wincurses.h' and 'keypad' for more information.)
+ * RETURN VALUE:   Returns OK if the cells were successfully allocated.
+ *                 Otherwise, ERR is returned.
  *
  *****************************************************************************/
 
-int getch(void)
+static int initcells(WINDOW *win)
 {
-	return wgetch(stdscr);
+	CHAR_INFO *c;
+	bool chunked;
+	int y, n;
+
+	/* Pads which are not subwindows keep their cells in chunks */
+	chunked = win->flags & WC_PAD && !win->parent;
+
+	/* Allocate memory for the cells and the pointers to each row */
+	win->cells = win->parent || chunked ? NULL
+			: malloc(sizeof(CHAR_INFO) * win->size.Y * win->size.X);
+	win->chunks = !chunked ? NULL : calloc(
+			(win->size.Y + WC_CHUNK - 1) / WC_CHUNK, sizeof(CHAR_INFO *));
+	win->blank = !chunked ? NULL
+			: malloc(sizeof(CHAR_INFO) * WC_CHUNK * win->size.X);
+	win->line = malloc(sizeof(CHAR_INFO *) * win->size.Y);
+	win->firstch = malloc(sizeof(short) * win->size.Y);
+	win->lastch = malloc(sizeof(short) * win->size.Y);
+	win->hash = malloc(sizeof(ULONGLONG) * win->size.Y);
+	win->hashok = malloc(sizeof(bool) * win->size.Y);
+
+	/* Sanity check: successfully allocated memory */
+	if ((!win->cells && !win->parent && !chunked)
+			|| (chunked && (!win->chunks || !win->blank)) || !win->line
+			|| !win->firstch || !win->lastch || !win->hash || !win->hashok) {
+		freecells(win);
+		return ERR;
+	}
+
+	/* Make sure the rows we share with a pad have cells of their own */
+	if (win->parent)
+		for (y = 0; y < win->size.Y; y++)
+			if (ownrow(win->parent, win->org.Y + y) == ERR) {
+				freecells(win);
+				return ERR;
+			}
+
+	/* Point each row at its first cell and mark it as changed */
+	for (y = 0; y < win->size.Y; y++) {
+		if (win->parent)
+			win->line[y] = win->parent->line[win->org.Y + y] + win->org.X;
+		else if (chunked)
+			win->line[y] = win->blank + y % WC_CHUNK * win->size.X;
+		else
+			win->line[y] = win->cells + y * win->size.X;
+		win->firstch[y] = 0;
+		win->lastch[y] = win->size.X - 1;
+		win->hashok[y] = FALSE;
+	}
+
+	/* A subwindow shows whatever its parent has */
+	if (win->parent) return OK;
+
+	/* Fill the cells (or the blank chunk) with the background character */
+	c = chunked ? win->blank : win->cells;
+	for (n = 0; n < (chunked ? WC_CHUNK : win->size.Y) * win->size.X; n++) {
+		c[n].Char.UnicodeChar = WC_BGND;
+		c[n].Attributes = win->attrs;
+	}
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * mvgetch
+ * freecells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x') and
- *                 reads a single character from 'stdscr'.
- *
- *                 (See 'mvwgetch' for more information.)
- *
- * RETURN VALUE:   Returns the character read or one of several KEY_*
- *                 constants (if the 'keypad' flag is set).
- *
- *                 (See 'wincurses.h' and 'keypad' for more information.)
+ * DESCRIPTION:    Frees the cells of the window pointed to by 'win' (unless
+ *                 they belong to its parent) and the information kept about
+ *                 each of its rows.
  *
  *****************************************************************************/
 
-int mvgetch(int y, int x)
+static void freecells(WINDOW *win)
 {
-	return mvwgetch(stdscr, y, x);
+	int i;
+
+	/* Free the chunks of a pad which were written to */
+	if (win->chunks)
+		for (i = 0; i < (win->size.Y + WC_CHUNK - 1) / WC_CHUNK; i++)
+			free(win->chunks[i]);
+	free(win->chunks);
+	free(win->blank);
+
+	free(win->cells);
+	free(win->line);
+	free(win->firstch);
+	free(win->lastch);
+	free(win->hash);
+	free(win->hashok);
 }
 
 
 /******************************************************************************
  *
- * mvwgetch
+ * mkwin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on the window pointed to by 'win'
- *                 to ('y', 'x') and reads a single character from the window
- *                 pointed to by 'win'.
- *
- *                 (See 'wmove' and 'wgetch' for more information.)
+ * DESCRIPTION:    Allocates a window with 'nlines' rows and 'ncols' columns
+ *                 whose upper left corner is at ('begin_y', 'begin_x') within
+ *                 the window pointed to by 'parent', or on the screen if
+ *                 'parent' is NULL. A window with a parent is a subwindow and
+ *                 shares its cells.
  *
- * RETURN VALUE:   Returns the character read or one of several KEY_* constants
- *                 (if the 'keypad' flag is set).
+ *                 The window starts out with the cursor in its upper left
+ *                 corner, the window-specific flags 'flags', and the
+ *                 attributes of its parent (or grey text on a black
+ *                 background). If 'flags' includes WC_PAD, the window is a pad
+ *                 which has not been shown anywhere yet.
  *
- *                 (See 'wincurses.h' and 'keypad' for more information.)
+ * RETURN VALUE:   Returns a pointer to the new window, or NULL if it could not
+ *                 be allocated.
  *
  *****************************************************************************/
 
-int mvwgetch(WINDOW *win, int y, int x)
+static WINDOW *mkwin(WINDOW *parent, wflags_t flags, int nlines, int ncols,
+		int begin_y, int begin_x)
 {
-	/* Move to the desired location */
-	wmove(stdscr, y, x);
+	WINDOW *win;
+
+	/* Allocate memory for a new window */
+	win = malloc(sizeof(WINDOW));
+
+	/* Sanity check: successfully allocated a window */
+	if (!win) return NULL;
+
+	/* Work out where the window is */
+	win->size.Y = nlines;
+	win->size.X = ncols;
+	win->parent = parent;
+	win->org.Y = begin_y;
+	win->org.X = begin_x;
+	win->nsub = 0;
+	if (flags & WC_PAD) {
+		win->rect.Top = win->rect.Left = 0;
+		win->rect.Bottom = win->rect.Right = -1;
+	}
+	else {
+		win->rect.Top = (parent ? parent->rect.Top : 0) + begin_y;
+		win->rect.Left = (parent ? parent->rect.Left : 0) + begin_x;
+		win->rect.Bottom = win->rect.Top + nlines - 1;
+		win->rect.Right = win->rect.Left + ncols - 1;
+	}
 
-	/* Get input from the window */
-	return wgetch(win);
+	/* Set the window up with its default values */
+	win->cur.Y = win->cur.X = 0;
+	win->flags = flags;
+	win->top = 0;
+	win->bot = nlines - 1;
+	win->delay = -1;
+	win->attrs = parent ? parent->attrs
+			: FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+	win->bkgd = parent ? parent->bkgd : A_NORMAL;
+
+	/* Allocate (or point at) the window's cells */
+	if (initcells(win) == ERR) {
+		free(win);
+		return NULL;
+	}
+
+	/* Subwindows share the lock of the window whose cells they share */
+	win->lock = parent ? parent->lock : malloc(sizeof(CRITICAL_SECTION));
+	if (!win->lock) {
+		freecells(win);
+		free(win);
+		return NULL;
+	}
+	if (!parent) InitializeCriticalSection(win->lock);
+
+	if (parent) parent->nsub++;
+
+	return win;
 }
 
 
 /******************************************************************************
  *
- * wgetch
+ * resizewin
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Reads a single character from the window pointed to by
- *                 'win'.
+ * DESCRIPTION:    Changes the size of the window pointed to by 'win' to
+ *                 'nlines' rows and 'ncols' columns. Its cells are
+ *                 reallocated (see 'initcells'), and the ones the old and new
+ *                 sizes have in common are copied over.
  *
- * RETURN VALUE:   Returns the character read or one of several KEY_*
- *                 constants (if the 'keypad' flag is set).
+ *                 New cells are filled with the cell pointed to by 'fill', or
+ *                 with the background character if 'fill' is NULL, and marked
+ *                 as changed. Rows which are as wide as before keep their
+ *                 hashes.
  *
- *                 (See 'wincurses.h' and 'keypad' for more information.)
+ *                 The cursor and the scrolling region are moved inside the
+ *                 window if they no longer fit, and a scrolling region which
+ *                 reached the bottom of the window still does.
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned and the
+ *                 window is left as it was.
  *
  *****************************************************************************/
 
-int wgetch(WINDOW *win)
+static int resizewin(WINDOW *win, int nlines, int ncols, CHAR_INFO *fill)
 {
-	INPUT_RECORD c;
-	int len, r;
+	WINDOW t;
+	int y, n, rows, cols, first, last;
+
+	/* Build the new cells in a copy of the window */
+	t = *win;
+	t.size.Y = nlines;
+	t.size.X = ncols;
+	if (initcells(&t) == ERR) return ERR;
+
+	/* Rows of a pad which were never written to keep showing its blank chunk */
+	if (t.chunks)
+		for (n = 0; n < WC_CHUNK * ncols; n++)
+			t.blank[n] = win->blank[0];
+
+	rows = nlines < win->size.Y ? nlines : win->size.Y;
+	cols = ncols < win->size.X ? ncols : win->size.X;
+
+	/* A subwindow's cells belong to its parent, so there is nothing to copy */
+	if (!t.parent) {
+		if (fill && t.cells)
+			for (n = 0; n < nlines * ncols; n++)
+				t.cells[n] = *fill;
+
+		for (y = 0; y < rows; y++) {
+			/* Rows of a pad which were never written to are still blank */
+			if (t.chunks && !win->chunks[y / WC_CHUNK]) continue;
+
+			if (ownrow(&t, y) == ERR) {
+				freecells(&t);
+				return ERR;
+			}
+			memcpy(t.line[y], win->line[y], sizeof(CHAR_INFO) * cols);
+		}
+	}
 
-	/* Poll the console for input */
-	do {
-		/* If we're in 'nodelay' mode and we have no input, */
-		if (win->flags & WC_NODELAY && !kbhit()) return ERR;
+	for (y = 0; y < rows; y++) {
+		/* Keep the changes made to the cells which are left */
+		first = win->firstch[y];
+		last = win->lastch[y] < ncols ? win->lastch[y] : ncols - 1;
+		if (first > last) first = last = WC_NOCHANGE;
 
-		ReadConsoleInput(hstdin, &c, 1, &len);
-	/* Wait until we have a key down event */
-	} while (c.EventType != KEY_EVENT || !c.Event.KeyEvent.bKeyDown);
+		/* And add any new columns */
+		if (ncols > win->size.X) {
+			if (first == WC_NOCHANGE) first = win->size.X;
+			last = ncols - 1;
+		}
 
-	/* Echo input if applicable */
-	if (flags & WC_ECHO) addch(c.Event.KeyEvent.uChar.AsciiChar);
+		t.firstch[y] = first;
+		t.lastch[y] = last;
 
-	/* By default, pass on the raw character value */
-	r = c.Event.KeyEvent.uChar.AsciiChar;
-
-	/* If we've chosen to translate special keys, */
-	if (win->flags & WC_WKEYPAD) {
-		/* Return the appropriate key code */
-		switch(c.Event.KeyEvent.wVirtualKeyCode) {
-			case VK_ESCAPE:             /* Escape key ==> Exit key */
-				r = KEY_EXIT;
-				break;
-			case VK_CANCEL:             /* Cancel key */
-				r = KEY_CANCEL;
-				break;
-			case VK_BACK:               /* Backspace key */
-				r = KEY_BACKSPACE;
-				break;
-			case VK_CLEAR:              /* Clear key */
-				r = KEY_CLEAR;
-				break;
-			case VK_RETURN:             /* Enter key */
-				r = KEY_ENTER;
-				break;
-			case VK_CONTROL:            /* Control key */
-				r = KEY_COMMAND;
-				break;
-			case VK_PRIOR:              /* Page up key */
-				r = KEY_PPAGE;
-				break;
-			case VK_NEXT:               /* Page down key */
-				r = KEY_NPAGE;
-				break;
-			case VK_END:                /* End key */
-				r = KEY_END;
-				break;
-			case VK_HOME:               /* Home key */
-				r = KEY_HOME;
-				break;
-			case VK_LEFT:               /* Left key */
-				r = KEY_LEFT;
-				break;
-			case VK_UP:                 /* Up key */
-				r = KEY_UP;
-				break;
-			case VK_RIGHT:              /* Right key */
-				r = KEY_RIGHT;
-				break;
-			case VK_DOWN:               /* Down key */
-				r = KEY_DOWN;
-				break;
-			case VK_SELECT:             /* Select key */
-				r = KEY_SELECT;
-				break;
-			case VK_PRINT:              /* Print key */
-				r = KEY_PRINT;
-				break;
-			case VK_DELETE:             /* Delete key */
-				r = KEY_DC;
-				break;
-			case VK_HELP:               /* Help key */
-				r = KEY_HELP;
-				break;
-			case VK_NUMPAD1:            /* Numeric keypad 1 key */
-				r = KEY_C1;
-				break;
-			case VK_NUMPAD2:            /* Numeric keypad 2 key */
-				r = KEY_DOWN;
-				break;
-			case VK_NUMPAD3:            /* Numeric keypad 3 key */
-				r = KEY_C3;
-				break;
-			case VK_NUMPAD4:            /* Numeric keypad 4 key */
-				r = KEY_LEFT;
-				break;
-			case VK_NUMPAD5:            /* Numeric keypad 5 key */
-				r = KEY_B2;
-				break;
-			case VK_NUMPAD6:            /* Numeric keypad 6 key */
-				r = KEY_RIGHT;
-				break;
-			case VK_NUMPAD7:            /* Numeric keypad 7 key */
-				r = KEY_A1;
-				break;
-			case VK_NUMPAD8:            /* Numeric keypad 8 key */
-				r = KEY_UP;
-				break;
-			case VK_NUMPAD9:            /* Numeric keypad 9 key */
-				r = KEY_A3;
-				break;
-			case VK_F1:                 /* F1 key */
-				r = KEY_F(1);
-				break;
-			case VK_F2:                 /* F2 key */
-				r = KEY_F(2);
-				break;
-			case VK_F3:                 /* F3 key */
-				r = KEY_F(3);
-				break;
-			case VK_F4:                 /* F4 key */
-				r = KEY_F(4);
-				break;
-			case VK_F5:                 /* F5 key */
-				r = KEY_F(5);
-				break;
-			case VK_F6:                 /* F6 key */
-				r = KEY_F(6);
-				break;
-			case VK_F7:                 /* F7 key */
-				r = KEY_F(7);
-				break;
-			case VK_F8:                 /* F8 key */
-				r = KEY_F(8);
-				break;
-			case VK_F9:                 /* F9 key */
-				r = KEY_F(9);
-				break;
-			case VK_F10:                /* F10 key */
-				r = KEY_F(10);
-				break;
-			case VK_F11:                /* F11 key */
-				r = KEY_F(11);
-				break;
-			case VK_F12:                /* F12 key */
-				r = KEY_F(12);
-				break;
-			case VK_F13:                /* F13 key */
-				r = KEY_F(13);
-				break;
-			case VK_F14:                /* F14 key */
-				r = KEY_F(14);
-				break;
-			case VK_F15:                /* F15 key */
-				r = KEY_F(15);
-				break;
-			case VK_F16:                /* F16 key */
-				r = KEY_F(16);
-				break;
-			case VK_F17:                /* F17 key */
-				r = KEY_F(17);
-				break;
-			case VK_F18:                /* F18 key */
-				r = KEY_F(18);
-				break;
-			case VK_F19:                /* F19 key */
-				r = KEY_F(19);
-				break;
-			case VK_F20:                /* F20 key */
-				r = KEY_F(20);
-				break;
-			case VK_F21:                /* F21 key */
-				r = KEY_F(21);
-				break;
-			case VK_F22:                /* F22 key */
-				r = KEY_F(22);
-				break;
-			case VK_F23:                /* F23 key */
-				r = KEY_F(23);
-				break;
-			case VK_F24:                /* F24 key */
-				r = KEY_F(24);
-				break;
+		/* The hash is still good if the row has the same cells */
+		if (ncols == win->size.X) {
+			t.hash[y] = win->hash[y];
+			t.hashok[y] = win->hashok[y];
 		}
 	}
 
-	return r;
+	/* Swap the new cells in */
+	freecells(win);
+	*win = t;
+
+	/* Cover the new size on the screen */
+	if (!(win->flags & WC_PAD)) {
+		win->rect.Bottom = win->rect.Top + nlines - 1;
+		win->rect.Right = win->rect.Left + ncols - 1;
+	}
+
+	/* Keep the cursor and the scrolling region inside the window */
+	if (win->cur.Y >= nlines) win->cur.Y = nlines - 1;
+	if (win->cur.X >= ncols) win->cur.X = ncols - 1;
+	if (win->bot == rows - 1 || win->bot >= nlines) win->bot = nlines - 1;
+	if (win->top > win->bot) win->top = 0;
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * echo
+ * markdirty
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables 'echo' mode in which characters are written to the
- *                 screen as they are typed.
+ * DESCRIPTION:    Records that the cells from column 'first' to column 'last',
+ *                 inclusive, of row 'y' in the window pointed to by 'win' have
+ *                 changed since the last refresh, which also means that the
+ *                 row's hash is out of date.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ *                 The cells of a subwindow belong to its parent, so they are
+ *                 marked as changed in the parent (and its parent) as well.
  *
- * NOTES:          This function always succeeds.
+ *                 This must be called before writing to the cells, since the
+ *                 row of a pad may need to be given cells of its own first.
+ *                 (See 'ownrow'.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a pad's row could not be given cells of its own.
  *
  *****************************************************************************/
 
-int echo(void)
+static int markdirty(WINDOW *win, int y, int first, int last)
 {
-	/* Set the echo input flag */
-	flags |= WC_ECHO;
+	/* Make sure the row can be written to */
+	if (ownrow(win, y) == ERR) return ERR;
+
+	/* The row's hash will have to be worked out again */
+	win->hashok[y] = FALSE;
+
+	/* Widen the changed range of the row to include the new columns */
+	if (win->firstch[y] == WC_NOCHANGE || first < win->firstch[y])
+		win->firstch[y] = first;
+	if (win->lastch[y] == WC_NOCHANGE || last > win->lastch[y])
+		win->lastch[y] = last;
+
+	/* Pass it on to the window these cells belong to */
+	if (win->parent)
+		return markdirty(win->parent, win->org.Y + y, win->org.X + first,
+				win->org.X + last);
 
 	return OK;
 }
@@ -992,24 +7527,47 @@ int echo(void)
 
 /******************************************************************************
  *
- * noecho
+ * fillcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Disables 'echo' mode.
+ * DESCRIPTION:    Sets the cells from column 'first' to column 'last',
+ *                 inclusive, of row 'y' in the window pointed to by 'win' to
+ *                 'fill', and marks them as changed.
  *
- *                 (See 'echo' for more information.)
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a pad's row could not be given cells of its own.
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ * NOTES:          The cells are filled like 'memset' would, by setting the
+ *                 first one and then copying the filled part over the rest in
+ *                 doubling steps, so that a row takes a handful of copies.
  *
- * NOTES:          This function always succeeds.
+ *                 A pad's row which has never been written to is left
+ *                 pointing at the blank chunk if that already holds 'fill'.
  *
  *****************************************************************************/
 
-int noecho(void)
+static int fillcells(WINDOW *win, int y, int first, int last, CHAR_INFO fill)
 {
-	/* Clear the echo input flag */
-	flags &= ~WC_ECHO;
+	CHAR_INFO *c;
+	int n = last - first + 1, k;
+
+	/* Nothing to do for an empty range */
+	if (n <= 0) return OK;
+
+	/* Leave rows of the blank chunk alone if they would not change */
+	if (win->chunks && !win->chunks[y / WC_CHUNK]
+			&& SAMECELL(win->blank[0], fill))
+		return OK;
+
+	/* Mark the cells as changed, which also makes them ours to write to */
+	if (markdirty(win, y, first, last) == ERR) return ERR;
+
+	/* Fill the first cell, then keep doubling the filled part */
+	c = &win->line[y][first];
+	c[0] = fill;
+	for (k = 1; k < n; k *= 2)
+		memcpy(c + k, c, sizeof(CHAR_INFO) * (k < n - k ? k : n - k));
 
 	return OK;
 }
@@ -1017,117 +7575,186 @@ int noecho(void)
 
 /******************************************************************************
  *
- * keypad
+ * bkgdcell
  *
  ******************************************************************************
  *
- * DESCRIPTION:    If 'bf' is 'TRUE', 'keypad' mode will be enabled in the
- *                 window pointed to by 'win'.
- *
- *                 If 'bf' is 'FALSE', 'keypad' mode will be disabled in the
- *                 window pointed to by 'win'.
- *
- *                 When in keypad mode, special character codes sent to the
- *                 window pointed to by 'win' are translated to one of the
- *                 KEY_* constants defined in 'wincurses.h'.
+ * DESCRIPTION:    Works out the cell which cleared cells of the window pointed
+ *                 to by 'win' are filled with: the character of its background
+ *                 (or 'WC_BGND' if it has none) with the background's
+ *                 attributes, or the window's if it has none (see
+ *                 'cellattrs').
  *
- * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns the cell.
  *
  *****************************************************************************/
 
-int keypad(WINDOW *win, bool bf)
+static CHAR_INFO bkgdcell(WINDOW *win)
 {
-	/* Sanity check: NULL pointer */
-	if (!win) return ERR;
+	CHAR_INFO fill;
 
-	/* If the flag value is 'FALSE', */
-	if (bf == FALSE)
-		/* Unset the window's keypad flag */
-		win->flags &= ~WC_WKEYPAD;
-	/* Else, */
-	else
-		/* Set the window's keypad flag */
-		win->flags |= WC_WKEYPAD;
+	fill.Char.UnicodeChar = win->bkgd & A_CHARTEXT
+			? (WCHAR)(win->bkgd & A_CHARTEXT) : WC_BGND;
+	fill.Attributes = cellattrs(win, win->bkgd);
 
-	return OK;
+	return fill;
 }
 
 
 /******************************************************************************
  *
- * cbreak
+ * overlap
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables 'cbreak' mode in which input is processed as it is
- *                 received but special character codes or combinations are
- *                 handled by the operating system.
+ * DESCRIPTION:    Works out where the windows pointed to by 'srcwin' and
+ *                 'dstwin' overlap on the screen and copies the source's
+ *                 cells there onto the destination (see 'copywin'), leaving
+ *                 out the source's blank cells if 'overlay' is TRUE.
  *
- * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
- *                 is returned.
+ *                 A pad is taken to be where it was last shown, covering only
+ *                 the part of the screen it was shown on and holding the part
+ *                 of the pad which was shown there (see 'pnoutrefresh').
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the windows do not overlap or a pad has never been
+ *                 shown.
  *
  *****************************************************************************/
 
-int cbreak(void)
+static int overlap(const WINDOW *srcwin, WINDOW *dstwin, int overlay)
 {
-	/* Clear the enable line input flag */
-	if (clearmode(hstdin, ENABLE_LINE_INPUT) == ERR)
-		return ERR;
+	int top, left, bot, right, sy, sx, dy, dx;
 
-	/* Set the enable processed input flag */
-	if (setmode(hstdin, ENABLE_PROCESSED_INPUT) == ERR)
+	/* Sanity check: NULL pointers */
+	if (!srcwin || !dstwin) return ERR;
+
+	/* Sanity check: a pad which has never been shown is nowhere */
+	if (srcwin->rect.Bottom < srcwin->rect.Top
+			|| dstwin->rect.Bottom < dstwin->rect.Top)
 		return ERR;
 
-	return OK;
+	/* Find the rectangle the windows share */
+	top = srcwin->rect.Top > dstwin->rect.Top
+			? srcwin->rect.Top : dstwin->rect.Top;
+	left = srcwin->rect.Left > dstwin->rect.Left
+			? srcwin->rect.Left : dstwin->rect.Left;
+	bot = srcwin->rect.Bottom < dstwin->rect.Bottom
+			? srcwin->rect.Bottom : dstwin->rect.Bottom;
+	right = srcwin->rect.Right < dstwin->rect.Right
+			? srcwin->rect.Right : dstwin->rect.Right;
+
+	/* Sanity check: the windows overlap */
+	if (top > bot || left > right) return ERR;
+
+	/* Find where the rectangle starts in each window (or the part shown) */
+	sy = top - srcwin->rect.Top;
+	sx = left - srcwin->rect.Left;
+	if (srcwin->flags & WC_PAD) {
+		sy += srcwin->view.Y;
+		sx += srcwin->view.X;
+	}
+	dy = top - dstwin->rect.Top;
+	dx = left - dstwin->rect.Left;
+	if (dstwin->flags & WC_PAD) {
+		dy += dstwin->view.Y;
+		dx += dstwin->view.X;
+	}
+
+	return copywin(srcwin, dstwin, sy, sx, dy, dx, dy + bot - top,
+			dx + right - left, overlay);
 }
 
 
 /******************************************************************************
  *
- * nocbreak
+ * blendcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Disables 'cbreak' mode.
- *
- *                 (See 'cbreak' for more information.)
+ * DESCRIPTION:    Copies the 'n' cells pointed to by 'src' onto those pointed
+ *                 to by 'dst', except for cells showing the character 'blank',
+ *                 which leave the destination's cell as it was.
  *
- * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
- *                 is returned.
+ * NOTES:          Where SSE2 is available (see 'WC_SSE2') and a cell is 32
+ *                 bits wide, four cells are blended at once: their characters
+ *                 are compared against 'blank' together, and the comparison
+ *                 picks between the source and destination cells without any
+ *                 branches. The rest are blended one at a time.
  *
  *****************************************************************************/
 
-int nocbreak(void)
+static void blendcells(CHAR_INFO *dst, const CHAR_INFO *src, int n, WCHAR blank)
 {
-	/* Set the enable line input and enable processed input flags */
-	return setmode(hstdin, ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+	int i = 0;
+#ifdef WC_SSE2
+	__m128i chars, blanks, s, d, keep;
+
+	if (sizeof(CHAR_INFO) == 4) {
+		/* The character is the low half of each 32-bit cell */
+		chars = _mm_set1_epi32(0xffff);
+		blanks = _mm_set1_epi32(blank);
+
+		for (; i + 4 <= n; i += 4) {
+			s = _mm_loadu_si128((const __m128i *)(src + i));
+			d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+			/* Keep the destination's cells where the source's are blank */
+			keep = _mm_cmpeq_epi32(_mm_and_si128(s, chars), blanks);
+			_mm_storeu_si128((__m128i *)(dst + i),
+					_mm_or_si128(_mm_and_si128(keep, d),
+							_mm_andnot_si128(keep, s)));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		if (src[i].Char.UnicodeChar != blank) dst[i] = src[i];
 }
 
 
 /******************************************************************************
  *
- * raw
+ * ownrow
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Enables 'raw' mode in which input is processed as it is
- *                 received and ALL characters or character codes are passed on
- *                 to the program.
+ * DESCRIPTION:    Makes sure that row 'y' of the window pointed to by 'win'
+ *                 can be written to. If the window is a pad and the row is in
+ *                 a chunk which has never been written to, the blank chunk is
+ *                 copied to make the chunk and its rows are pointed at it.
  *
- * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
- *                 is returned.
+ *                 Other windows can always be written to. (The rows which a
+ *                 subwindow shares with a pad were given cells of their own
+ *                 when the subwindow was created.)
+ *
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when the chunk could not be allocated.
  *
  *****************************************************************************/
 
-int raw(void)
+static int ownrow(WINDOW *win, int y)
 {
-	/* Clear the enable line input flag */
-	if (clearmode(hstdin, ENABLE_LINE_INPUT) == ERR)
-		return ERR;
+	CHAR_INFO *c;
+	int i, first, n;
 
-	/* Clear the enable processed input flag */
-	if (clearmode(hstdin, ENABLE_PROCESSED_INPUT) == ERR)
-		return ERR;
+	/* Nothing to do unless this is a chunk which has never been written to */
+	if (!win->chunks || win->chunks[y / WC_CHUNK]) return OK;
+
+	/* Copy the blank chunk */
+	i = y / WC_CHUNK;
+	c = malloc(sizeof(CHAR_INFO) * WC_CHUNK * win->size.X);
+
+	/* Sanity check: successfully allocated memory */
+	if (!c) return ERR;
+
+	memcpy(c, win->blank, sizeof(CHAR_INFO) * WC_CHUNK * win->size.X);
+	win->chunks[i] = c;
+
+	/* Point the rows of the chunk at it */
+	first = i * WC_CHUNK;
+	for (n = 0; n < WC_CHUNK && first + n < win->size.Y; n++)
+		win->line[first + n] = c + n * win->size.X;
 
 	return OK;
 }
@@ -1135,613 +7762,1141 @@ int raw(void)
 
 /******************************************************************************
  *
- * noraw
+ * flushcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Disables 'raw' mode.
+ * DESCRIPTION:    Writes the 'n' spans of cells in the 'spans' array from the
+ *                 window pointed to by 'win' to the console screen buffer with
+ *                 handle 'hcon', making one console call per span.
  *
- *                 (See 'raw' for more information.)
+ *                 (See 'diffcells' for more information.)
  *
- * RETURN VALUE:   Returns OK if mode was successfully changed. Otherwise, ERR
- *                 is returned.
+ * RETURN VALUE:   Returns OK if the cells were successfully written.
+ *                 Otherwise, ERR is returned.
  *
  *****************************************************************************/
 
-int noraw(void)
+static int flushcells(WINDOW *win, HANDLE hcon, SMALL_RECT *spans, int n)
 {
-	/* Set the enable line input and enable processed input flags */
-	return setmode(hstdin, ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+	SMALL_RECT rect;
+	COORD orig;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		/* Write the span straight from our cells */
+		rect = spans[i];
+		orig.Y = rect.Top;
+		orig.X = rect.Left;
+		if (!WriteConsoleOutputW(hcon, win->cells, tocoord(win->size), orig,
+				&rect))
+			return ERR;
+		concalls++;
+		WC_COUNT(writes, 1);
+	}
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * move
+ * diffcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on 'stdscr' to ('y', 'x').
+ * DESCRIPTION:    Compares the changed cells of the window pointed to by 'win'
+ *                 against the window pointed to by 'shadow', saves the spans
+ *                 of cells which differ to the 'spans' array, and copies those
+ *                 cells into 'shadow' so that it matches 'win'.
  *
- * RETURN VALUE:   Returns OK if the destination coordinates were within window
- *                 bounds. Otherwise, ERR is returned.
+ *                 Runs of differing cells on a row are joined into one span
+ *                 when no more than 'spangap' unchanged cells separate them.
+ *                 Consecutive rows with the same spans are merged into
+ *                 rectangles covering all of those rows.
+ *
+ *                 Changed rows whose hashes are already known to be the same
+ *                 in both windows (such as after 'findscroll') are skipped
+ *                 once a single 'memcmp' of their changed cells agrees, rather
+ *                 than comparing them cell by cell. (Checking the cells means
+ *                 that two different rows which happen to share a hash can't
+ *                 leave stale cells on the console.)
+ *
+ *                 Afterwards, every row of 'win' is marked as unchanged.
+ *
+ * RETURN VALUE:   Returns the number of spans saved to 'spans', which must be
+ *                 large enough to hold half a span per cell, plus one per row.
  *
  *****************************************************************************/
 
-int move(int y, int x)
+static int diffcells(WINDOW *win, WINDOW *shadow, SMALL_RECT *spans)
 {
-	return wmove(stdscr, y, x);
+	CHAR_INFO *w, *s;
+	int y, x, n = 0, row, k, prev = 0, i;
+
+	for (y = 0; y < win->size.Y; y++) {
+		/* The spans of this row start here */
+		row = n;
+
+		/* Only look at rows which have changed */
+		if (win->firstch[y] != WC_NOCHANGE) {
+			w = win->line[y];
+			s = shadow->line[y];
+
+			/* Skip rows which hash the same, once their cells agree too */
+			x = win->firstch[y];
+			if (win->hashok[y] && shadow->hashok[y]
+					&& win->hash[y] == shadow->hash[y]
+					&& !memcmp(w + x, s + x,
+						sizeof(CHAR_INFO) * (win->lastch[y] - x + 1)))
+				x = win->lastch[y] + 1;
+			WC_COUNT(rows, 1);
+			WC_COUNT(diffed, win->lastch[y] - x + 1);
+
+			for (; x <= win->lastch[y]; x++) {
+				/* Skip cells which are the same */
+				if (SAMECELL(w[x], s[x])) continue;
+
+				/* Join a span on this row if the gap is small enough */
+				if (n > row && x - spans[n - 1].Right - 1 <= spangap) {
+					spans[n - 1].Right = x;
+					continue;
+				}
+
+				/* Otherwise, start a new span */
+				spans[n].Top = spans[n].Bottom = y;
+				spans[n].Left = spans[n].Right = x;
+				n++;
+			}
+
+			/* Bring the shadow up to date */
+			if (n > row)
+				memcpy(s + spans[row].Left, w + spans[row].Left,
+						sizeof(CHAR_INFO)
+						* (spans[n - 1].Right - spans[row].Left + 1));
+
+			/* The rows are now the same, so they share a hash (if known) */
+			shadow->hash[y] = win->hash[y];
+			shadow->hashok[y] = win->hashok[y];
+
+			win->firstch[y] = win->lastch[y] = WC_NOCHANGE;
+		}
+
+		/*
+		 * If this row has the same spans as the row above it, drop them and
+		 * extend the spans of the row above instead. (Those are always the
+		 * last 'prev' spans saved.)
+		 */
+		k = n - row;
+		if (k && k == prev) {
+			for (i = 0; i < k; i++)
+				if (spans[row - k + i].Left != spans[row + i].Left
+						|| spans[row - k + i].Right != spans[row + i].Right)
+					break;
+			if (i == k) {
+				for (i = 0; i < k; i++)
+					spans[row - k + i].Bottom = y;
+				n = row;
+			}
+		}
+		prev = k;
+	}
+
+	return n;
 }
 
 
 /******************************************************************************
  *
- * wmove
+ * getscratch
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Moves the cursor location on 'win' to ('y', 'x').
+ * DESCRIPTION:    Makes sure that the scratch memory pointed to by 'scratch'
+ *                 is at least 'len' bytes long, growing it if necessary.
  *
- * RETURN VALUE:   Returns OK if the destination coordinates were within window
- *                 bounds. Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns a pointer to the scratch memory, or NULL if it could
+ *                 not be grown.
+ *
+ * NOTES:          The scratch memory is shared, so its contents are only valid
+ *                 until the next call to 'getscratch'.
  *
  *****************************************************************************/
 
-int wmove(WINDOW *win, int y, int x)
+static void *getscratch(size_t len)
 {
-	/* Sanity check: within bounds? */
-	if (y >= win->size.Y || x >= win->size.X || y < 0 || x < 0)
-		return ERR;
+	void *p;
 
-	/* Set the cursor position */
-	win->cur.Y = y;
-	win->cur.X = x;
+	/* Only reallocate when we need more space than we already have */
+	if (len > scratchlen) {
+		p = realloc(scratch, len);
 
-	return OK;
+		/* Sanity check: successfully allocated memory */
+		if (!p) return NULL;
+
+		scratch = p;
+		scratchlen = len;
+	}
+
+	return scratch;
 }
 
 
 /******************************************************************************
  *
- * can_change_color
+ * newline
  *
  ******************************************************************************
  *
- * RETURN VALUE:   Returns TRUE if the terminal supports user-defined colors,
- *                 Otherwise, FALSE is returned.
+ * DESCRIPTION:    Advances the cursor of the window pointed to by 'win' to the
+ *                 next row. If scrolling is enabled with 'scrollok' and the
+ *                 cursor is on the bottom row of the scrolling region, the
+ *                 region scrolls up a row instead.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
  *****************************************************************************/
 
-bool can_change_color(void)
+static int newline(WINDOW *win)
 {
-	return CAN_CHANGE_COLOR;
+	if (win->cur.Y == win->bot && win->flags & WC_SCROLLOK)
+		return wscrl(win, 1);
+
+	win->cur.Y++;
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * color_content
+ * shiftcells
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Given a color number, assigns pointers to the red, green,
- *                 and blue color components for the color indexed in the
- *                 'colors' array by 'color'. The pointers are assigned to
- *                 'red', 'green', and 'blue', respectively.
+ * DESCRIPTION:    Moves the cells of the rows from 'top' to 'bot', inclusive,
+ *                 in the window pointed to by 'win' up by 'n' rows, or down if
+ *                 'n' is negative, and sets every cell of the exposed rows to
+ *                 'fill'. All of the rows are marked as changed, but the rows
+ *                 which only moved keep their hashes.
  *
- * RETURN VALUE:   Returns the color pair value if colors are available.
- *                 Otherwise, ERR is returned.
+ * RETURN VALUE:   Returns OK on success. Otherwise, ERR is returned, such as
+ *                 when a pad's rows could not be given cells of their own.
  *
  *****************************************************************************/
 
-int color_content(short color, short *red, short *green, short *blue)
+static int shiftcells(WINDOW *win, int top, int bot, int n, CHAR_INFO fill)
 {
-	/* Make sure we are using colors and have values within range */
-	if (flags & WC_COLOR && has_colors() && can_change_color() &&
-			color < COLORS && color > 0) {
-		/* Assign pointers to our color values */
-		red   = &colors[color].r;
-		green = &colors[color].g;
-		blue  = &colors[color].b;
-		return OK;
-	} else return ERR;
+	int rows = bot - top + 1, y, x;
+
+	/* Shifting by the whole region (or more) just clears it */
+	if (n > rows) n = rows;
+	if (n < -rows) n = -rows;
+
+	/* Make sure every row of the region can be written to */
+	for (y = top; y <= bot; y++)
+		if (ownrow(win, y) == ERR) return ERR;
+
+	/* Copy the rows which stay, in an order which does not overwrite any */
+	if (n > 0) {
+		for (y = top; y <= bot - n; y++) {
+			memcpy(win->line[y], win->line[y + n],
+					sizeof(CHAR_INFO) * win->size.X);
+			win->hash[y] = win->hash[y + n];
+			win->hashok[y] = win->hashok[y + n];
+		}
+	}
+	else {
+		for (y = bot; y >= top - n; y--) {
+			memcpy(win->line[y], win->line[y + n],
+					sizeof(CHAR_INFO) * win->size.X);
+			win->hash[y] = win->hash[y + n];
+			win->hashok[y] = win->hashok[y + n];
+		}
+	}
+
+	/* Fill the exposed rows */
+	for (y = n > 0 ? bot - n + 1 : top; y <= (n > 0 ? bot : top - n - 1); y++) {
+		for (x = 0; x < win->size.X; x++)
+			win->line[y][x] = fill;
+		win->hashok[y] = FALSE;
+	}
+
+	/*
+	 * Every row of the region has changed. (The moved rows keep their hashes,
+	 * so only the parent is told with 'markdirty'.)
+	 */
+	for (y = top; y <= bot; y++) {
+		win->firstch[y] = 0;
+		win->lastch[y] = win->size.X - 1;
+		if (win->parent)
+			markdirty(win->parent, win->org.Y + y, win->org.X,
+					win->org.X + win->size.X - 1);
+	}
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * COLOR_PAIR
+ * linehash
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Given a color pair number, returns the value as it would be
- *                 extracted from a chtype.
+ * DESCRIPTION:    Makes sure that the hash of the characters and attributes of
+ *                 row 'y' in the window pointed to by 'win' is up to date,
+ *                 working it out (using 64-bit FNV-1a) only if the row has
+ *                 changed since it was last hashed.
  *
- * RETURN VALUE:   Returns the color pair value of the given color pair number.
+ * RETURN VALUE:   Returns the hash.
  *
  *****************************************************************************/
 
-int COLOR_PAIR(int n)
+static ULONGLONG linehash(WINDOW *win, int y)
 {
-	/* Return the high-order color bits */
-	return (n << (32 - COLOR_BITS));
+	CHAR_INFO *c;
+	ULONGLONG h;
+	int x;
+
+	/* Use the hash we already have if the row has not changed */
+	if (win->hashok[y]) return win->hash[y];
+
+	h = 14695981039346656037ull;
+	c = win->line[y];
+	for (x = 0; x < win->size.X; x++) {
+		h = (h ^ c[x].Char.UnicodeChar) * 1099511628211ull;
+		h = (h ^ c[x].Attributes) * 1099511628211ull;
+	}
+
+	win->hash[y] = h;
+	win->hashok[y] = TRUE;
+
+	return h;
 }
 
 
 /******************************************************************************
  *
- * has_colors
+ * findscroll
  *
  ******************************************************************************
  *
- * RETURN VALUE:   Returns TRUE if the terminal supports colors. Otherwise,
- *                 FALSE is returned.
+ * DESCRIPTION:    Looks for a run of rows in the window pointed to by 'win'
+ *                 which all match rows of the window pointed to by 'shadow'
+ *                 the same distance above or below them, as they do after a
+ *                 scroll. Rows are compared by their hashes (see 'linehash'),
+ *                 and the 'same' array, which needs a word per row plus one,
+ *                 is used to count the rows which are already in place.
+ *
+ *                 Only the range of changed rows is searched, and only if at
+ *                 least 'WC_SCROLLMIN' rows have changed. Scrolling a region
+ *                 must save at least that many rows from being rewritten,
+ *                 counting those which would no longer be in place afterwards.
+ *
+ * RETURN VALUE:   Returns the number of rows to scroll the region from row
+ *                 'top' to row 'bot' up by (or down by, if negative) to make
+ *                 the most rows of 'shadow' match 'win', or zero if scrolling
+ *                 would not save enough.
+ *
+ * NOTES:          Two different rows could share a hash, but at worst that
+ *                 makes a scroll which saves less than it should: every row
+ *                 which scrolls is compared again by 'diffcells', which checks
+ *                 the cells of rows whose hashes match before skipping them.
  *
  *****************************************************************************/
 
-bool has_colors(void)
+static int findscroll(WINDOW *win, WINDOW *shadow, DWORD *same, int *top,
+		int *bot)
 {
-	COLORS = 0;
-	COLOR_PAIRS = 0;
+	ULONGLONG *newh, *oldh;
+	int first = -1, last = 0, dirty = 0, m, y, n, start, lo, hi, gain;
+	int best = 0, most = WC_SCROLLMIN - 1;
+
+	/* Find the range of changed rows */
+	for (y = 0; y < win->size.Y; y++) {
+		if (win->firstch[y] == WC_NOCHANGE) continue;
+		if (first < 0) first = y;
+		last = y;
+		dirty++;
+	}
 
-	if (HAS_COLORS == TRUE) {
-		/* Set up our global variables */
-		COLORS = NUM_COLORS;
-		COLOR_PAIRS = MAX_NUM_PAIRS;
+	/* Only bother if enough rows changed to be worth scrolling */
+	if (dirty < WC_SCROLLMIN) return 0;
+
+	/*
+	 * Hash the rows of both windows in the range, counting how many of the
+	 * first 'y' are already in place as 'same[y]'
+	 */
+	m = last - first + 1;
+	newh = win->hash + first;
+	oldh = shadow->hash + first;
+	same[0] = 0;
+	for (y = 0; y < m; y++)
+		same[y + 1] = same[y]
+				+ (linehash(win, first + y) == linehash(shadow, first + y));
+
+	/* Try each distance, following every run of rows which match after it */
+	for (n = 1 - m; n < m; n++) {
+		if (!n) continue;
+		start = -1;
+		for (y = n > 0 ? 0 : -n; y < (n > 0 ? m - n : m); y++) {
+			/* A row which does not match ends the run */
+			if (newh[y] != oldh[y + n]) {
+				start = -1;
+				continue;
+			}
+			if (start < 0) start = y;
+
+			/*
+			 * The region covers the run and the rows it came from. Rows of
+			 * the region which were already in place will need rewriting.
+			 */
+			lo = n > 0 ? start : start + n;
+			hi = n > 0 ? y + n : y;
+			gain = y - start + 1 - (int)(same[hi + 1] - same[lo]);
+			if (gain > most) {
+				most = gain;
+				best = n;
+				*top = first + lo;
+				*bot = first + hi;
+			}
+		}
 	}
 
-	return HAS_COLORS;
+	return best;
 }
 
 
 /******************************************************************************
  *
- * init_color
+ * tocoord
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Initializes a user-defined color by replacing an old one.
+ * DESCRIPTION:    Converts the window position or size 'pos' to the COORD
+ *                 which the console API expects.
  *
- *                 'color' refers to the existing color to be replaced by the
- *                 red, green, and blue intensities given by 'red', 'green',
- *                 and 'blue', respectively, all within the range of 0 to 1000,
- *                 inclusive.
+ * RETURN VALUE:   Returns the converted position or size.
  *
- * RETURN VALUE:   Returns OK if the color was set up correctly. Otherwise, ERR
- *                 is returned.
+ *****************************************************************************/
+
+static COORD tocoord(wcoord_t pos)
+{
+	COORD c;
+
+	c.Y = (SHORT)pos.Y;
+	c.X = (SHORT)pos.X;
+
+	return c;
+}
+
+
+/******************************************************************************
  *
- * NOTES:          Windows does not support this functionality. However, for
- *                 completeness, we have set up a framework if it were to be
- *                 emulated somehow.
+ * readevents
  *
- *                 Basically, though we are using Windows console flags to
- *                 control color usage, we actually are able to address RGB
- *                 values.
+ ******************************************************************************
  *
- *                 Namely, colors are applied based upon color pair data stored
- *                 in each window's 'attrs' variable. (In fact, the color pair
- *                 can be extracted using the 'A_COLOR_DATA' macro, passing it
- *                 the 'attrs' variable in question.) This, in turn, merely
- *                 points to an index in the global 'color_pairs' array, which
- *                 contains a listing of 'color_t' foreground and background
- *                 colors.
+ * DESCRIPTION:    Reads up to 'WC_INPUTBATCH' console input records at once
+ *                 and adds the key presses, mouse, size change and focus
+ *                 events among them to the input queue, discarding everything
+ *                 else (key releases and menu events). A key held down long
+ *                 enough to repeat is added once for each repeat.
  *
- *                 This feature has not beed tested and code is provided mainly
- *                 for demonstration purposes.
+ *                 If 'wait' is 'TRUE', waits for at least one record to
+ *                 read. Otherwise, only reads records which are already
+ *                 waiting.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
+ *
+ * NOTES:          No more records are read than the queue has room for, and
+ *                 repeats (and anything after them) which do not fit are
+ *                 dropped.
+ *
+ *                 Key presses are translated with 'keymap' as they are read,
+ *                 so 'wgetch' only has to pick the translation or the raw
+ *                 character depending on the 'keypad' flag.
  *
  *****************************************************************************/
 
-int init_color(short color, short red, short green, short blue)
+static int readevents(bool wait)
 {
-	/* Make sure we are using colors and have values within range */
-	if (flags & WC_COLOR && has_colors() && can_change_color() &&
-			color < COLORS && color > 0) {
-		/* Make sure our color values are within range */
-		if (red > 1000 || green > 1000 || blue > 1000 ||
-				red < 0 || green < 0 || blue < 0)
-			return ERR;
+	INPUT_RECORD recs[WC_INPUTBATCH];
+	KEY_EVENT_RECORD *k;
+	MOUSE_EVENT_RECORD *m;
+	DWORD n, i, room;
+	WORD rep, reps;
+	wcevent_t *c;
+
+	/* Only read as many records as the queue has room for */
+	room = WC_EVQ - (evtail - evhead);
+	if (room > WC_INPUTBATCH) room = WC_INPUTBATCH;
+	if (!room) return OK;
+
+	/* Let the output backend do the reading */
+	if (output->read(recs, room, &n, wait) == ERR) return ERR;
+	WC_COUNT(records, n);
+
+	for (i = 0; i < n; i++) {
+		/* Drop whatever doesn't fit (only possible with repeated keys) */
+		if (evtail - evhead == WC_EVQ) {
+			WC_COUNT(dropped, n - i);
+			break;
+		}
 
-		/* TODO: Add support for custom colors */
-		/* Assign our color value */
-		colors[color].r = red;
-		colors[color].g = green;
-		colors[color].b = blue;
+		switch (recs[i].EventType) {
+			case KEY_EVENT:
+				/* Only keep key presses */
+				k = &recs[i].Event.KeyEvent;
+				if (!k->bKeyDown) {
+					WC_COUNT(dropped, 1);
+					break;
+				}
+
+				/* Add one for each repeat, as long as there is room */
+				reps = k->wRepeatCount ? k->wRepeatCount : 1;
+				for (rep = 0; rep < reps && evtail - evhead < WC_EVQ; rep++) {
+					c = &evq[evtail++ % WC_EVQ];
+					c->type = WC_EVKEY;
+					c->vk = k->wVirtualKeyCode;
+					c->state = k->dwControlKeyState;
+					c->ch = k->uChar.AsciiChar;
+					c->key = mapkey(c);
+				}
+
+				/* Count the repeats which didn't fit */
+				WC_COUNT(dropped, reps - rep);
+				break;
 
-		return OK;
-	} else return ERR;
+			case MOUSE_EVENT:
+				m = &recs[i].Event.MouseEvent;
+				c = &evq[evtail++ % WC_EVQ];
+				c->type = WC_EVMOUSE;
+				c->pos.Y = m->dwMousePosition.Y;
+				c->pos.X = m->dwMousePosition.X;
+				c->buttons = m->dwButtonState;
+				c->how = m->dwEventFlags;
+				c->state = m->dwControlKeyState;
+				break;
+
+			case WINDOW_BUFFER_SIZE_EVENT:
+				c = &evq[evtail++ % WC_EVQ];
+				c->type = WC_EVRESIZE;
+				c->pos.Y = recs[i].Event.WindowBufferSizeEvent.dwSize.Y;
+				c->pos.X = recs[i].Event.WindowBufferSizeEvent.dwSize.X;
+				break;
+
+			case FOCUS_EVENT:
+				c = &evq[evtail++ % WC_EVQ];
+				c->type = WC_EVFOCUS;
+				c->focus = recs[i].Event.FocusEvent.bSetFocus ? TRUE : FALSE;
+				break;
+
+			default:
+				/* Menu events are of no use to us */
+				WC_COUNT(dropped, 1);
+				break;
+		}
+	}
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * init_pair
+ * waitkeys
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Initializes a pair of foreground and background colors for
- *                 later use.
+ * DESCRIPTION:    Waits up to 'delay' milliseconds (or forever if 'delay' is
+ *                 negative) for a key press to reach the front of the input
+ *                 queue, discarding any other events ahead of it.
  *
- *                 Both 'f' and 'b' refer to indices within the global 'colors'
- *                 array.
+ *                 A change in the size of the console also stops the wait,
+ *                 once the screen has been resized to match (see
+ *                 'checksize'), so that 'wgetch' can return KEY_RESIZE.
  *
- * RETURN VALUE:   Returns OK if the color pair was set up correctly.
- *                 Otherwise, ERR is returned.
+ *                 Timed waits are done on the console input handle, so the
+ *                 operating system wakes us up as input arrives. Since input
+ *                 is taken off of the console as it is read, input which
+ *                 isn't a key press doesn't keep the handle signaled and we
+ *                 go back to sleep for the rest of the delay.
+ *
+ *                 A frame held back by the frame rate limit is written while
+ *                 waiting, as soon as it is due (see 'frametick').
+ *
+ * RETURN VALUE:   Returns OK if there is a key press (or size change) at the
+ *                 front of the queue. If the delay runs out first or there is
+ *                 a failure, ERR is returned.
  *
  *****************************************************************************/
 
-int init_pair(short pair, short f, short b)
+static int waitkeys(int delay)
 {
-	/*
-	 * Make sure we are using colors and have values within range. (Note that
-	 * we do not change pair number zero as it is the default console
-	 * foreground and background.)
-	 */
-	if (flags & WC_COLOR && has_colors() && pair < COLOR_PAIRS && pair > 0) {
-		/* Assign our color values */
-		color_pairs[pair].f = f;
-		color_pairs[pair].b = b;
-		return OK;
-	} else return ERR;
+	DWORD start, waited, left;
+	int frame;
+
+	/* Note when we started, for working out how long is left to wait */
+	start = GetTickCount();
+
+	for (;;) {
+		/* Write a held back frame once it is due (see 'frametick') */
+		frame = frametick();
+
+		/*
+		 * Drop any events which aren't key presses ahead of the next one,
+		 * except for changes in size which actually resize the screen
+		 */
+		while (evhead != evtail && evq[evhead % WC_EVQ].type != WC_EVKEY
+				&& (evq[evhead % WC_EVQ].type != WC_EVRESIZE || !checksize()))
+			evhead++;
+		if (evhead != evtail) break;
+
+		/*
+		 * Without a delay (or a frame to wake up for), block until the console
+		 * has input to read
+		 */
+		if (delay < 0 && frame < 0) {
+			if (readevents(TRUE) == ERR) return ERR;
+			continue;
+		}
+
+		/* Take whatever is waiting (and check it for key presses next time) */
+		if (readevents(FALSE) == ERR) return ERR;
+		if (evhead != evtail) continue;
+
+		/* Give up once the delay has run out */
+		if (delay < 0)
+			left = INFINITE;
+		else {
+			waited = GetTickCount() - start;
+			if (waited >= (DWORD)delay) return ERR;
+			left = (DWORD)delay - waited;
+		}
+
+		/* Wake up in time to write a held back frame */
+		if (frame >= 0 && (DWORD)frame < left) left = frame;
+
+		/* Sleep until input arrives or the rest of the delay runs out */
+		if (WaitForSingleObject(hstdin, left) == WAIT_FAILED)
+			return ERR;
+	}
+
+	return OK;
 }
 
 
 /******************************************************************************
  *
- * pair_content
+ * frametick
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Modifies 'f' and 'b' to point to the respective foreground
- *                 and background values for the given pair.
+ * DESCRIPTION:    Writes the frame being held back by the frame rate limit
+ *                 (see 'wc_framerate') if it has come due.
  *
- * RETURN VALUE:   Returns OK if the color pair was accessible. Otherwise, ERR
- *                 is returned.
+ * RETURN VALUE:   Returns the number of milliseconds until the frame being
+ *                 held back is due, or -1 if no frame is being held back
+ *                 (including when it was just written).
  *
  *****************************************************************************/
 
-int pair_content(short pair, short *f, short *b)
+static int frametick(void)
 {
-	/* Make sure we are using colors and have values within range */
-	if (flags & WC_COLOR && has_colors() && pair < COLOR_PAIRS && pair >= 0) {
-		/* Assign our color pointer values */
-		f = &color_pairs[pair].f;
-		b = &color_pairs[pair].b;
-		return OK;
-	} else return ERR;
+	DWORD elapsed;
+	int r = -1;
+
+	/* Another thread may be refreshing */
+	EnterCriticalSection(&scrlock);
+
+	/* Nothing to do unless a refresh is being held back */
+	if (framestale) {
+		/* Say how long there is to go if it is not due yet */
+		elapsed = GetTickCount() - lastframe;
+		if (framems > 0 && elapsed < (DWORD)framems)
+			r = (int)((DWORD)framems - elapsed);
+
+		/* Otherwise, write it now */
+		else
+			wc_flush();
+	}
+
+	LeaveCriticalSection(&scrlock);
+
+	return r;
 }
 
 
 /******************************************************************************
  *
- * PAIR_NUMBER
+ * framelen
  *
  ******************************************************************************
  *
- * DESCRIPTION:    (See 'A_COLOR_DATA' in 'wincurses.h' for more information.)
+ * DESCRIPTION:    Works out how much memory 'drawframe' needs to draw the
+ *                 window pointed to by 'win': enough for the most spans it
+ *                 can have, and a word per row (plus one) to look for rows
+ *                 which have moved.
  *
- * RETURN VALUE:   Returns the color pair number given a color pair value.
+ * RETURN VALUE:   Returns the number of bytes needed.
  *
  *****************************************************************************/
 
-int PAIR_NUMBER(int value)
+static size_t framelen(WINDOW *win)
 {
-	return A_COLOR_DATA(value);
+	return sizeof(SMALL_RECT) * win->size.Y * (win->size.X / 2 + 1)
+			+ sizeof(DWORD) * (win->size.Y + 1);
 }
 
 
 /******************************************************************************
  *
- * start_color
+ * drawframe
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Initializes color mode for the console. Namely, it sets up
- *                 the bit masks for the various console colors, sets the
- *                 console colors to the default set (white foreground text on
- *                 a black background) and turns colors on globally.
+ * DESCRIPTION:    Updates the console with the changed cells of the window
+ *                 pointed to by 'win' (either 'newscr' or a frame copied from
+ *                 it), using the memory pointed to by 'mem', which must be at
+ *                 least 'framelen' bytes long.
  *
- * RETURN VALUE:   Returns OK if colors were set up correctly on the console
- *                 Otherwise, ERR is returned.
+ *                 Changed cells are found by comparing the window against
+ *                 'curscr' in memory, so the console is never read from. They
+ *                 are grouped into rectangular spans which are handed to the
+ *                 output backend to write.
+ *
+ *                 Before that, rows which have only moved up or down since the
+ *                 last update (such as when a log scrolls) are found by
+ *                 hashing them, and the output backend scrolls them in place
+ *                 so that just the newly exposed rows need to be written.
+ *
+ *                 If the window asks for the screen to be redrawn (see
+ *                 'clearok'), every cell is written instead.
+ *
+ *                 The number of console calls made is saved in 'concalls'.
+ *
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
  *****************************************************************************/
 
-int start_color(void)
+static int drawframe(WINDOW *win, void *mem)
 {
-	/* Make sure we are using colors */
-	if (has_colors()) {
-		/* Initialize the eight basic console colors */
-		colors[COLOR_BLACK].r   = 0;
-		colors[COLOR_BLACK].g   = 0;
-		colors[COLOR_BLACK].b   = 0;
+	SMALL_RECT *spans;
+	DWORD *same;
+	CHAR_INFO unknown;
+	int n, top, bot, y;
 
-		colors[COLOR_BLUE].r    = 0;
-		colors[COLOR_BLUE].g    = 0;
-		colors[COLOR_BLUE].b    = 1000;
+	concalls = 0;
 
-		colors[COLOR_GREEN].r   = 0;
-		colors[COLOR_GREEN].g   = 1000;
-		colors[COLOR_GREEN].b   = 0;
+	/* The spans go at the start of the memory and the row words at the end */
+	spans = mem;
+	same = (DWORD *)((char *)mem + framelen(win)) - (win->size.Y + 1);
 
-		colors[COLOR_CYAN].r    = 0;
-		colors[COLOR_CYAN].g    = 1000;
-		colors[COLOR_CYAN].b    = 1000;
+	/*
+	 * If the screen is to be redrawn, forget what the console shows so that
+	 * every cell is written again
+	 */
+	if (win->flags & WC_CLEAROK) {
+		memset(curscr->cells, 0,
+				sizeof(CHAR_INFO) * curscr->size.Y * curscr->size.X);
+		for (y = 0; y < win->size.Y; y++) {
+			curscr->hashok[y] = FALSE;
+			win->firstch[y] = 0;
+			win->lastch[y] = win->size.X - 1;
+		}
+		win->flags &= ~WC_CLEAROK;
+	}
 
-		colors[COLOR_RED].r     = 1000;
-		colors[COLOR_RED].g     = 0;
-		colors[COLOR_RED].b     = 0;
+	WC_COUNT(frames, 1);
 
-		colors[COLOR_MAGENTA].r = 1000;
-		colors[COLOR_MAGENTA].g = 0;
-		colors[COLOR_MAGENTA].b = 1000;
+	/* Scroll the console if enough rows have moved up or down together */
+	WC_START(WC_PDIFF);
+	n = findscroll(win, curscr, same, &top, &bot);
+	WC_STOP(WC_PDIFF);
+	if (n) {
+		WC_START(WC_PFLUSH);
+		if (output->scroll(top, bot, n) == ERR) return ERR;
+		WC_STOP(WC_PFLUSH);
 
-		colors[COLOR_YELLOW].r  = 1000;
-		colors[COLOR_YELLOW].g  = 1000;
-		colors[COLOR_YELLOW].b  = 0;
+		/*
+		 * Curscr scrolls along with the console, but whatever fills the
+		 * exposed rows is not known, so they must all be written.
+		 */
+		memset(&unknown, 0, sizeof(CHAR_INFO));
+		shiftcells(curscr, top, bot, n, unknown);
 
-		colors[COLOR_WHITE].r   = 1000;
-		colors[COLOR_WHITE].g   = 1000;
-		colors[COLOR_WHITE].b   = 1000;
+		/*
+		 * Every row which scrolled needs to be compared again. (Their cells
+		 * have not changed, so unlike 'markdirty', keep their hashes.)
+		 */
+		for (y = top; y <= bot; y++) {
+			win->firstch[y] = 0;
+			win->lastch[y] = win->size.X - 1;
+		}
+	}
 
-		/* Set up the console defaults */
-		init_pair(0, COLOR_WHITE, COLOR_BLACK);
-		attrset(COLOR_PAIR(0));
+	/* Find the spans of cells which differ from the console */
+	WC_START(WC_PDIFF);
+	n = diffcells(win, curscr, spans);
+	WC_STOP(WC_PDIFF);
+	WC_COUNT(written, spancells(spans, n));
 
-		/* Turn colors on globally */
-		flags |= WC_COLOR;
+	/* Write them out */
+	WC_START(WC_PFLUSH);
+	n = output->flush(win, spans, n);
+	WC_STOP(WC_PFLUSH);
+	WC_COUNT(calls, concalls);
 
-		return OK;
-	} else return ERR;
+	return n;
 }
 
 
 /******************************************************************************
  *
- * curs_set
+ * postframe
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Sets the visibility mode of the cursor depending on the
- *                 value of 'visibility'.
+ * DESCRIPTION:    Hands a copy of 'newscr' to the render thread (see
+ *                 'wc_render') to be drawn, and marks every row of 'newscr'
+ *                 as unchanged.
  *
- *                 0 means make the cursor invisible.
- *                 1 means make the cursor normal visibility.
- *                 2 means make the cursor have increased visibility.
+ *                 The copy is made into 'rback', which is then swapped for
+ *                 'rmid'. What comes back is either a frame the render thread
+ *                 has finished with, or (if it is still busy) the last frame
+ *                 handed over, which it has not started on yet. Either way,
+ *                 it is filled with the next frame, so frames which are
+ *                 replaced before they are drawn are merged into the next one
+ *                 rather than queued up.
  *
- * RETURN VALUE:   Returns OK if cursor visibility was set correctly. Otherwise
- *                 ERR is returned.
+ * RETURN VALUE:   Returns OK on success or ERR on failure.
  *
  *****************************************************************************/
 
-int curs_set(int visibility)
+static int postframe(void)
 {
-	int r;
-	CONSOLE_CURSOR_INFO curinfo, curold;
+	WINDOW *f = rback;
+	int y;
 
-	/* Get our old cursor information */
-	r = GetConsoleCursorInfo(stdscr->hcon[stdscr->prim], &curold);
-	if (!r) return ERR;
+	/* Make sure the frame is the size of the screen */
+	if ((f->size.Y != newscr->size.Y || f->size.X != newscr->size.X)
+			&& resizewin(f, newscr->size.Y, newscr->size.X, NULL) == ERR)
+		return ERR;
 
-	/* Copy our old cursor information to our new cursor */
-	curinfo = curold;
+	WC_START(WC_PBUILD);
 
-	/* Assign the proper visibility */
-	switch (visibility) {
-		case 0:		/* Invisible */
-			curinfo.bVisible = FALSE;
-			break;
-		case 1:		/* Normal visibility */
-			curinfo.bVisible = TRUE;
-			curinfo.dwSize = cursize;
-			break;
-		case 2:		/* High visibility */
-			curinfo.bVisible = TRUE;
-			curinfo.dwSize = 100;
-			break;
-		default:
-			return ERR;
+	/*
+	 * Copy every row, since the frame may be a few frames behind. (The render
+	 * thread works out which rows actually differ from the console.)
+	 */
+	for (y = 0; y < newscr->size.Y; y++) {
+		memcpy(f->line[y], newscr->line[y], sizeof(CHAR_INFO) * f->size.X);
+		newscr->firstch[y] = newscr->lastch[y] = WC_NOCHANGE;
 	}
+	f->cur = newscr->cur;
+	WC_STOP(WC_PBUILD);
 
-	/* Apply the new visibility settings to all buffers */
-	r = SetConsoleCursorInfo(stdscr->hcon[stdscr->prim], &curinfo);
-	r |= SetConsoleCursorInfo(stdscr->hcon[stdscr->bbuf], &curinfo);
-	if (!r) return ERR;
-
-	/* Return our old state */
-	if (curold.bVisible == FALSE) return 0;
-	if (curold.dwSize == cursize) return 1;
-	return 2;
-}
+	/* Keep any request to redraw the screen from a frame which was replaced */
+	f->flags |= WC_FRESH | (newscr->flags & WC_CLEAROK);
+	newscr->flags &= ~WC_CLEAROK;
 
+	/* Hand it over, and wake the render thread up to draw it */
+	rback = InterlockedExchangePointer((PVOID volatile *)&rmid, f);
+	SetEvent(rwake);
 
-/******************************************************************************
- * Windows-specific helper function declarations follow.
- *****************************************************************************/
+	return OK;
+}
 
 
 /******************************************************************************
  *
- * cls
+ * renderloop
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Clears the console screen buffer pointed to by 'hcon' by
- *                 filling it with the character 'WC_BGND'.
+ * DESCRIPTION:    Runs the render thread started by 'wc_render', which sleeps
+ *                 until it is woken up and then draws the frames handed over
+ *                 by 'postframe' until there are none left, until it is asked
+ *                 to stop.
+ *
+ *                 Each frame is swapped out of 'rmid' for the one last drawn.
+ *                 The rows which differ from 'curscr' are found by comparing
+ *                 them (rows which are the same take the hash 'curscr' has
+ *                 for them), then the frame is drawn with 'drawframe'.
+ *
+ *                 The render thread is the only one to touch 'curscr' and the
+ *                 output backend while it runs. (Anything else which needs
+ *                 them calls 'renderwait' first.)
+ *
+ * RETURN VALUE:   Returns zero.
+ *
+ * NOTES:          A frame which could not be drawn is dropped. Since
+ *                 'curscr' still says what the console shows, the next frame
+ *                 makes up for it.
  *
  *****************************************************************************/
 
-void cls(HANDLE hcon)
+static DWORD WINAPI renderloop(LPVOID arg)
 {
-	CONSOLE_SCREEN_BUFFER_INFO coninfo;
-	COORD orig;
-	DWORD len, size;
+	WINDOW *f;
+	void *mem = NULL, *p;
+	size_t len = 0;
+	bool stop;
+	LONG gen;
+	int y;
 
-	/* Get console information */
-	GetConsoleScreenBufferInfo(hcon, &coninfo);
+	for (;;) {
+		/* Sleep until there is something to do */
+		WaitForSingleObject(rwake, INFINITE);
 
-	/* Calculate the number of spaces to fill ('size') */
-	size = coninfo.dwSize.Y * coninfo.dwSize.X;
+		/*
+		 * Check these first, so that frames handed over before are drawn
+		 * before we say we are done
+		 */
+		stop = rstop;
+		gen = InterlockedCompareExchange(&rasked, 0, 0);
+
+		/* Keep swapping frames until one comes back which has been drawn */
+		for (;;) {
+			f = InterlockedExchangePointer((PVOID volatile *)&rmid, rfront);
+			rfront = f;
+			if (!(f->flags & WC_FRESH)) break;
+			f->flags &= ~WC_FRESH;
+
+			/* Mark the rows which differ from the console as changed */
+			for (y = 0; y < f->size.Y; y++) {
+				if (memcmp(f->line[y], curscr->line[y],
+						sizeof(CHAR_INFO) * f->size.X)) {
+					f->firstch[y] = 0;
+					f->lastch[y] = f->size.X - 1;
+					f->hashok[y] = FALSE;
+				} else {
+					f->firstch[y] = f->lastch[y] = WC_NOCHANGE;
+					f->hash[y] = curscr->hash[y];
+					f->hashok[y] = curscr->hashok[y];
+				}
+			}
+
+			/* Grow our own memory to draw with if need be */
+			if (framelen(f) > len) {
+				p = realloc(mem, framelen(f));
+				if (!p) continue;
+				mem = p;
+				len = framelen(f);
+			}
+
+			drawframe(f, mem);
+		}
 
-	/* We want to start at (0, 0) */
-	orig.Y = orig.X = 0;
+		/* Let 'renderwait' know how far we have got */
+		InterlockedExchange(&rdone, gen);
+		SetEvent(ridle);
 
-	/*
-	 * Now fill 'size' characters with WG_BGND (defined in wincurses.h)
-	 * starting at 'orig'.
-	 */
-	FillConsoleOutputCharacter(hcon, WC_BGND, size, orig, &len);
+		if (stop) break;
+	}
+
+	free(mem);
+
+	return 0;
 }
 
 
 /******************************************************************************
  *
- * setmode
+ * renderwait
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Sets the particular console mode specified by the bitmask
- *                 on the console with handle specified by 'hcon'.
+ * DESCRIPTION:    Waits until the render thread (if there is one) has drawn
+ *                 every frame handed to it, so that 'curscr' and the output
+ *                 backend can be used until the next frame is handed over.
  *
- * RETURN VALUE:   Returns OK if the mode was successfully set. Otherwise, ERR
- *                 is returned.
+ * NOTES:          Each wait asks for a new generation in 'rasked', and is
+ *                 over once the render thread has found no frame left to
+ *                 draw after seeing it. (So a thread which was running out of
+ *                 frames just as another was handed over can't end the wait
+ *                 early.)
  *
  *****************************************************************************/
 
-int setmode(HANDLE hcon, DWORD bmask)
+static void renderwait(void)
 {
-	DWORD mode;
-
-	/* Get the current console mode */
-	if (!GetConsoleMode(hcon, &mode));
-		/* Return ERR on error */
-		return ERR;
+	LONG gen;
 
-	/* Apply the bit mask */
-	mode |= bmask;
+	if (!rthread) return;
 
-	/* Set the new console mode and return its status */
-	return SetConsoleMode(hcon, mode) ? OK : ERR;
+	/* Wake the render thread up and wait for it to catch up with us */
+	gen = InterlockedIncrement(&rasked);
+	SetEvent(rwake);
+	while (InterlockedCompareExchange(&rdone, 0, 0) - gen < 0)
+		WaitForSingleObject(ridle, INFINITE);
 }
 
 
 /******************************************************************************
  *
- * clearmode
+ * mkframe
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Clears the particular console mode specified by the bitmask
- *                 on the console with handle specified by 'hcon'.
+ * DESCRIPTION:    Makes a frame for handing to the render thread: a window
+ *                 the size of 'newscr', with no flags set.
  *
- * RETURN VALUE:   Returns OK if the mode was successfully set. Otherwise, ERR
- *                 is returned.
+ * RETURN VALUE:   Returns a pointer to the frame, or NULL if it could not be
+ *                 allocated.
  *
  *****************************************************************************/
 
-int clearmode(HANDLE hcon, DWORD bmask)
+static WINDOW *mkframe(void)
 {
-	DWORD mode;
+	WINDOW *f;
 
-	/* Get the current console mode */
-	if (!GetConsoleMode(hcon, &mode))
-		/* Return ERR on error */
-		return ERR;
+	/* Allocate memory for the frame */
+	f = malloc(sizeof(WINDOW));
 
-	/* Apply the bit mask */
-	mode &= ~bmask;
+	/* Sanity check: successfully allocated a frame */
+	if (!f) return NULL;
 
-	/* Set the new console mode and return its status */
-	return SetConsoleMode(hcon, mode) ? OK : ERR;
+	/* The frame is laid out like newscr */
+	*f = *newscr;
+	f->flags = 0;
+	if (initcells(f) == ERR) {
+		free(f);
+		return NULL;
+	}
+
+	return f;
 }
 
 
 /******************************************************************************
  *
- * va_wprintw
+ * freeframe
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Helper function to aid the *printw functions in their tasks
- *                 by printing from a va_list 'list' using a specified format,
- *                 'fmt' in the window pointed to by 'win'.
+ * DESCRIPTION:    Frees the frame pointed to by 'win' made by 'mkframe' (if
+ *                 there is one).
  *
- * RETURN VALUE:   Returns OK if the mode was successfully set. Otherwise, ERR
- *                 is returned, such as in the case when there is not enough
- *                 screen space to write the formatted text.
+ *****************************************************************************/
+
+static void freeframe(WINDOW *win)
+{
+	if (!win) return;
+
+	freecells(win);
+	free(win);
+}
+
+
+/******************************************************************************
+ *
+ * spancells
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Counts the cells covered by the 'n' spans in the 'spans'
+ *                 array.
+ *
+ * RETURN VALUE:   Returns the number of cells.
  *
  *****************************************************************************/
 
-int va_wprintw(WINDOW *win, char *fmt, va_list *args)
+static int spancells(SMALL_RECT *spans, int n)
 {
-	char *s;
-	int n = 0;
+	int i, cells = 0;
 
-	/* Allocate enough memory to hold the formatted string */
-	s = malloc(sizeof(char) * stdscr->size.Y * stdscr->size.X);
+	for (i = 0; i < n; i++)
+		cells += (spans[i].Bottom - spans[i].Top + 1)
+				* (spans[i].Right - spans[i].Left + 1);
 
-	/* Save our formatted string into a temporary location in a safe way */
-	if (vsprintf_s(s, stdscr->size.Y * stdscr->size.X, fmt, *args) < 0)
-		return ERR;
+	return cells;
+}
 
-	/* Print our formatted string */
-	while (s[n] && waddch(win, s[n]) == OK)
-		n++;
 
-	return OK;
+/******************************************************************************
+ *
+ * statstop
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Adds the time since 'phase' (one of WC_P*) was started with
+ *                 'WC_START' to the time spent in it (see 'wc_stats').
+ *
+ *****************************************************************************/
+
+static void statstop(int phase)
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+	phaseticks[phase] += now.QuadPart - phasestart[phase].QuadPart;
 }
 
 
 /******************************************************************************
  *
- * getattrs
+ * checksize
  *
  ******************************************************************************
  *
- * DESCRIPTION:    Translates 'attrs' into a Windows-specific console display
- *                 attributes bit mask.
+ * DESCRIPTION:    Checks whether the size of the console's window has changed
+ *                 and if so, resizes the screen to match (see 'resizeterm').
  *
- * RETURN VALUE:   Returns a bitmask representing Windows-specific console
- *                 display attributes.
+ * RETURN VALUE:   Returns TRUE if the screen was resized. Otherwise (if the
+ *                 size has not changed or the screen could not be resized),
+ *                 FALSE is returned.
  *
- * NOTES:          The current implementation uses Windows console bit masks to
- *                 represent colors. Presumably, any ARGB color combination can
- *                 be represented and implemented under the current design.
+ * NOTES:          The console reports a change in size whenever its buffer
+ *                 is resized, including by us, so reports are only trusted
+ *                 after checking the size for ourselves.
  *
  *****************************************************************************/
 
-WORD getattrs(unsigned int attrs)
+static bool checksize(void)
 {
-	WORD bmask = 0;
+	int lines, cols;
 
-	/* Set up our bit mask */
-	if (attrs & A_BOLD)      bmask |= FOREGROUND_INTENSITY;
-	if (attrs & A_REVERSE)   bmask |= COMMON_LVB_REVERSE_VIDEO;
-	if (attrs & A_STANDOUT)  bmask |= BACKGROUND_INTENSITY;
-	if (attrs & A_UNDERLINE) bmask |= COMMON_LVB_UNDERSCORE;
-	/* TODO: Add support for custom colors */
-	/* Apply colors using console flags if we cannot change them */
-	if (flags & WC_COLOR && can_change_color() == FALSE) {
-		int colormask =
-				((colors[color_pairs[PAIR_NUMBER(attrs)].f].r == 0
-					? 0 : FOREGROUND_RED) |
-				(colors[color_pairs[PAIR_NUMBER(attrs)].f].g == 0
-					? 0 : FOREGROUND_GREEN) |
-				(colors[color_pairs[PAIR_NUMBER(attrs)].f].b == 0
-					? 0 : FOREGROUND_BLUE));
-		bmask |= colormask;
-		/*
-		 * We use the 'FTOB' macro to derive the Windows console background
-		 * color flag from a Windows console foreground flag. (It's just a bit
-		 * shift.)
-		 */
-		colormask =
-				(((colors[color_pairs[PAIR_NUMBER(attrs)].b].r == 0)
-					? 0 : FOREGROUND_RED) |
-				((colors[color_pairs[PAIR_NUMBER(attrs)].b].g == 0)
-					? 0 : FOREGROUND_GREEN) |
-				((colors[color_pairs[PAIR_NUMBER(attrs)].b].b == 0)
-					? 0 : FOREGROUND_BLUE));
-		bmask |= FTOB(colormask);
-	}
+	/* Ask the output backend */
+	if (output->size(&lines, &cols) == ERR) return FALSE;
+	if (lines == newscr->size.Y && cols == newscr->size.X) return FALSE;
 
-	return bmask;
+	return resizeterm(lines, cols) == OK;
+}
+
+
+/******************************************************************************
+ *
+ * mapkey
+ *
+ ******************************************************************************
+ *
+ * DESCRIPTION:    Looks up the key code for the key press pointed to by 'c' in
+ *                 'keymap', taking the modifier keys held into account.
+ *                 Control takes precedence over alt, and alt over shift.
+ *
+ * RETURN VALUE:   Returns the KEY_* constant for the key press, or zero if it
+ *                 has none.
+ *
+ *****************************************************************************/
+
+static int mapkey(wcevent_t *c)
+{
+	int mod;
+
+	/* Work out which modifier keys matter */
+	if (c->state & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
+		mod = WC_MODCTRL;
+	else if (c->state & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED))
+		mod = WC_MODALT;
+	else if (c->state & SHIFT_PRESSED)
+		mod = WC_MODSHIFT;
+	else
+		mod = WC_MODNONE;
+
+	/* Fall back on the key code without modifiers */
+	if (keymap[c->vk & 0xff][mod]) return keymap[c->vk & 0xff][mod];
+	return keymap[c->vk & 0xff][WC_MODNONE];
 }
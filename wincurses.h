@@ -18,9 +18,21 @@
 #define __WINCURSES__
 
 #include <windows.h>
-#include <conio.h> /* For 'kbhit' */
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/*
+ * Blend cells four at a time with SSE2 where the compiler targets it (every
+ * x64 processor has it). (See 'blendcells'.)
+ */
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) \
+		|| defined(__SSE2__)
+#define WC_SSE2
+#include <emmintrin.h>
+#endif
 
 #define EOF -1
 #define ERR 0
@@ -44,15 +56,85 @@ typedef int bool;
 /* Background character (fills the screen when cleared) */
 #define WC_BGND ' '
 
+/* Marks a row with no changed cells since the last refresh */
+#define WC_NOCHANGE -1
+
+/*
+ * The default number of unchanged cells 'refresh' will rewrite to join two
+ * runs of changed cells on the same row into one console write. (See
+ * 'wc_spangap'.)
+ */
+#define WC_SPANGAP 32
+
+/*
+ * The fewest rows 'refresh' must save from being rewritten before it scrolls
+ * part of the console instead.
+ */
+#define WC_SCROLLMIN 3
+
+/*
+ * The number of rows in each chunk of a pad's cells. (Pads only allocate the
+ * chunks which have been written to.)
+ */
+#define WC_CHUNK 64
+
+/* The most console input records read at once */
+#define WC_INPUTBATCH 64
+
+/* The number of events the input queue holds (must be a power of two) */
+#define WC_EVQ 256
+
+/* The size of the memory backend's screen when 'initscr' sets it up */
+#define WC_MEMLINES 25
+#define WC_MEMCOLS 80
+
+/* The most handles which can be registered with 'wc_addhandle' */
+#define WC_MAXHANDLES (MAXIMUM_WAIT_OBJECTS - 1)
+
+/*
+ * The size of the buffer each 'printw' conversion is formatted into first.
+ * (Longer conversions are formatted again into the scratch memory.)
+ */
+#define WC_FMTBUF 64
+
+/* The size of the buffer holding a single 'printw' conversion specification */
+#define WC_SPECLEN 48
+
+/*
+ * The most wide characters a 'cchar_t' holds (a spacing character and its
+ * combining characters)
+ */
+#define CCHARW_MAX 5
+
+/* Replaces characters which cannot be stored in a cell */
+#define WC_BADCHAR 0xfffd
+
+/* A one in every byte of a 64-bit word (for checking 8 characters at once) */
+#define WC_ONES 0x0101010101010101ull
+
 /* Global program flags */
 typedef enum _flags {
 	_WC_ECHO = 0,
 	_WC_COLOR,
+	_WC_SINGLEBUF, /* Use one console buffer instead of two */
 } _flags_t;
 
 /* Global program flag bit masks */
 #define WC_ECHO (1 << _WC_ECHO)
 #define WC_COLOR (1 << _WC_COLOR)
+#define WC_SINGLEBUF (1 << _WC_SINGLEBUF)
+
+/*
+ * CHARACTER LAYOUT
+ *
+ * A 'chtype' carries a character in its low-order 8 bits, any A_* attributes
+ * above it, and a color pair in its high-order 'COLOR_BITS' bits, so that a
+ * character can be written with its own attributes.
+ *
+ * chtype -> XXXXXX000000000AAAAAAAAACCCCCCCC
+ *           \____/         \_______/\______/
+ *           A_COLOR        A_* bits  A_CHARTEXT
+ */
 
 /*
  * COLOR DATA LAYOUT
@@ -94,19 +176,50 @@ typedef struct colorinfo {
 /* Convert from Windows foreground to background bitmasks */
 #define FTOB(f) (f << 4)
 
+/* The Windows console attribute bits which make up a color pair */
+#define WC_COLORFLAGS (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE \
+		| BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE)
+
+/* Queues a string literal for output by the virtual terminal backend */
+#define VTPUTS(s) vtput(s, sizeof(s) - 1)
+
+/* Compares two cells for equal characters and attributes */
+#define SAMECELL(a, b) ((a).Char.UnicodeChar == (b).Char.UnicodeChar \
+		&& (a).Attributes == (b).Attributes)
+
+/*
+ * Counting and timing what updates cost (see 'wc_stats') is only compiled in
+ * when WC_STATS is defined. Otherwise, these do nothing.
+ */
+#ifdef WC_STATS
+#define WC_COUNT(field, n) (stats.field += (n))
+#define WC_START(phase) QueryPerformanceCounter(&phasestart[phase])
+#define WC_STOP(phase) statstop(phase)
+#else
+#define WC_COUNT(field, n) ((void)0)
+#define WC_START(phase) ((void)0)
+#define WC_STOP(phase) ((void)0)
+#endif
+
 /* Window-specific flags */
 typedef enum _wflags {
 	_WC_WKEYPAD = 0, /* KEY_* translations */
-	_WC_NODELAY      /* 'No delay' mode */
+	_WC_SCROLLOK,    /* Scroll when the cursor leaves the scrolling region */
+	_WC_PAD,         /* Pad (not tied to a place on the screen) */
+	_WC_CLEAROK,     /* Redraw the whole screen on the next refresh */
+	_WC_FRESH        /* Frame not yet drawn by the render thread */
 } _wflags_t;
 
 /* Window-specific flag bit masks */
 #define WC_WKEYPAD (1 << _WC_WKEYPAD)
-#define WC_NODELAY (1 << _WC_NODELAY)
+#define WC_SCROLLOK (1 << _WC_SCROLLOK)
+#define WC_PAD (1 << _WC_PAD)
+#define WC_CLEAROK (1 << _WC_CLEAROK)
+#define WC_FRESH (1 << _WC_FRESH)
 
-/* Attributes */
+/* Attributes (above the character bits of a 'chtype') */
 typedef enum _attr {
-	_A_ALTCHARSET = 0, /* Alternate character set */
+	_A_ALTCHARSET = 8, /* Alternate character set */
 	_A_BLINK,          /* Blinking */
 	_A_BOLD,           /* Extra bright or bold */
 	_A_DIM,            /* Half bright */
@@ -131,6 +244,14 @@ typedef enum attr {
 	A_UNDERLINE  = (1 << _A_UNDERLINE),
 } attr_t;
 
+/* No attributes */
+#define A_NORMAL 0
+
+/* Bit masks for the parts of a 'chtype' */
+#define A_CHARTEXT 0xff
+#define A_COLOR (((1u << COLOR_BITS) - 1) << (32 - COLOR_BITS))
+#define A_ATTRIBUTES (~(chtype)A_CHARTEXT)
+
 
 /* Boolean type */
 typedef int bool;
@@ -147,9 +268,6 @@ typedef enum colorcode {
 	COLOR_WHITE
 } colorcode_t;
 
-/* Color value */
-color_t colors[NUM_COLORS];
-
 /* Key codes, mapped to Windows key codes when applicable */
 typedef enum keycode {
 	KEY_CODE_YES = 256,         /* Variable contains a key code */
@@ -254,14 +372,26 @@ typedef enum keycode {
 	KEY_SSUSPEND,               /* Shifted suspend key */
 	KEY_SUNDO,                  /* Shifted undo key */
 	KEY_SUSPEND,                /* Suspend key */
-	KEY_UNDO                    /* Undo key */
+	KEY_UNDO,                   /* Undo key */
+	KEY_RESIZE                  /* Console was resized */
 } keycode_t;
 
 /* For function key definitions */
 #define KEY_F(n) (KEY_F0 + n)
 
-/* Character type */
-typedef char chtype;
+/* Character type, with attributes and a color pair (see 'CHARACTER LAYOUT') */
+typedef unsigned int chtype;
+
+/*
+ * Wide character type: attributes and a color pair (laid out as in a
+ * 'chtype', with no character) and a string of wide characters. (Only the
+ * first character is displayed, since console cells cannot combine
+ * characters.)
+ */
+typedef struct cchar {
+	chtype attr;
+	wchar_t chars[CCHARW_MAX];
+} cchar_t;
 
 /* Global program flags type */
 typedef unsigned int flags_t;
@@ -269,79 +399,392 @@ typedef unsigned int flags_t;
 /* Window-specific flags type */
 typedef unsigned int wflags_t;
 
+/*
+ * A position or size within a window. (Unlike COORD, its members are wide
+ * enough for pads with more rows than a SHORT can count.)
+ */
+typedef struct wcoord {
+	int Y;
+	int X;
+} wcoord_t;
+
+/* Modifier keys which can change the key code of a key press */
+typedef enum _keymods {
+	WC_MODNONE = 0, /* No modifier keys */
+	WC_MODSHIFT,    /* Shift */
+	WC_MODCTRL,     /* Control */
+	WC_MODALT,      /* Alt */
+	WC_MODS         /* (The number of modifier key combinations) */
+} _keymods_t;
+
+/* Kinds of input events */
+typedef enum _wcevents {
+	WC_EVKEY = 0, /* Key press */
+	WC_EVMOUSE,   /* Mouse button press or release, movement, or wheel */
+	WC_EVRESIZE,  /* Change in the size of the console screen buffer */
+	WC_EVFOCUS,   /* Console window gaining or losing focus */
+	WC_EVHANDLE   /* Signaled handle (see 'wc_addhandle') */
+} _wcevents_t;
+
+/*
+ * An input event read from the console, waiting to be returned by 'wgetch'
+ * (key presses only) or 'wc_poll', or a signaled handle returned by 'wc_poll'.
+ * Only the fields used by the kind of event are set.
+ */
+typedef struct wcevent {
+	int type;      /* Kind of event (one of WC_EV*) */
+	DWORD state;   /* State of the modifier keys (keys and mouse) */
+	WORD vk;       /* Virtual key code (keys) */
+	char ch;       /* Character (keys) */
+	int key;       /* KEY_* constant, or zero if there is none (keys) */
+	wcoord_t pos;  /* Cell under the mouse (mouse) or new size (resize) */
+	DWORD buttons; /* Buttons held and wheel movement (mouse) */
+	DWORD how;     /* Movement, double click or wheel flags (mouse) */
+	bool focus;    /* Whether focus was gained (focus) */
+	HANDLE handle; /* The signaled handle (handles) */
+	void *data;    /* The pointer registered with the handle (handles) */
+} wcevent_t;
+
+/* Types of argument taken by a 'printw' conversion */
+typedef enum _wcargs {
+	WC_ARGINT = 0, /* int (and anything shorter) */
+	WC_ARGLONG,    /* long */
+	WC_ARGLLONG,   /* long long (__int64) */
+	WC_ARGSIZE,    /* size_t (and ptrdiff_t) */
+	WC_ARGDBL,     /* double */
+	WC_ARGLDBL,    /* long double */
+	WC_ARGPTR      /* Any pointer */
+} _wcargs_t;
+
+/*
+ * A conversion parsed from a 'printw' format string, along with the argument
+ * it was given (see 'parsespec')
+ */
+typedef struct wcarg {
+	char conv;  /* Conversion character */
+	int prec;   /* Precision, or -1 if none was given */
+	bool plain; /* Whether there are no flags, width or length modifiers */
+	int type;   /* Type of argument (one of WC_ARG*) */
+	union {
+		int i;
+		long l;
+		LONGLONG ll;
+		SIZE_T z;
+		double d;
+		long double ld;
+		void *p;
+	} v;
+} wcarg_t;
+
+/* Phases of an update which are timed (see 'wc_stats') */
+typedef enum _wcphases {
+	WC_PBUILD = 0, /* Copying windows onto 'newscr' (and frames from it) */
+	WC_PDIFF,      /* Finding what has changed */
+	WC_PFLUSH,     /* Writing it to the console */
+	WC_PHASES      /* (The number of phases) */
+} _wcphases_t;
+
+/*
+ * What updates have cost since 'wc_stats' was last called (or since the
+ * program started). Times are in microseconds.
+ */
+typedef struct wcstats {
+	unsigned long frames;  /* Frames drawn */
+	unsigned long rows;    /* Changed rows compared against the console */
+	unsigned long diffed;  /* Cells compared against the console */
+	unsigned long written; /* Cells handed to the output backend to write */
+	unsigned long calls;   /* Console output calls of any kind */
+	unsigned long writes;  /* WriteConsoleOutput calls */
+	unsigned long scrolls; /* ScrollConsoleScreenBuffer calls */
+	unsigned long files;   /* WriteFile calls (by the WC_VT backend) */
+	ULONGLONG bytes;       /* Bytes written by the WC_VT backend */
+	unsigned long records; /* Console input records read */
+	unsigned long dropped; /* Input records and key repeats dropped */
+	ULONGLONG build;       /* Time spent in the WC_PBUILD phase */
+	ULONGLONG diff;        /* Time spent in the WC_PDIFF phase */
+	ULONGLONG flush;       /* Time spent in the WC_PFLUSH phase */
+} wcstats_t;
+
 /* Window type */
 typedef struct window_t
 {
-	/* Window region and size */
+	/*
+	 * Window region on the screen (or for pads, the region last shown on by
+	 * 'pnoutrefresh') and size
+	 */
 	SMALL_RECT rect;
-	COORD size;
+	wcoord_t size;
+
+	/*
+	 * The window whose cells this window shares (if it is a subwindow), where
+	 * this window begins within it, and how many subwindows share this
+	 * window's cells
+	 */
+	struct window_t *parent;
+	wcoord_t org;
+	int nsub;
+
+	/* For pads, the upper left cell last shown by 'pnoutrefresh' */
+	wcoord_t view;
 
 	/* Coordinate of cursor */
-	COORD cur;
+	wcoord_t cur;
+
+	/*
+	 * The window's character cells, stored contiguously row by row, and a
+	 * pointer to the first cell of each row. (Output functions write here;
+	 * the console buffers are only touched by 'doupdate'.) Subwindows have no
+	 * cells of their own, and their rows point into their parent's cells.
+	 */
+	CHAR_INFO *cells;
+	CHAR_INFO **line;
 
 	/*
-	 * Two handles to console screen buffers. (Only one is active at a time,
-	 * while the other is used as a back buffer.)
+	 * Pads keep their cells in chunks of 'WC_CHUNK' rows instead. Chunks which
+	 * have never been written to are NULL and their rows point into a single
+	 * blank chunk, which is copied to make the chunk when it is first written.
 	 */
-	HANDLE hcon[2];
+	CHAR_INFO **chunks;
+	CHAR_INFO *blank;
 
 	/*
-	 * The indices of the console screen buffer being used as the primary and
-	 * back buffer.
+	 * The first and last changed columns of each row since the last refresh,
+	 * or WC_NOCHANGE if a row has not changed.
 	 */
-	int prim, bbuf;
+	short *firstch, *lastch;
+
+	/*
+	 * A hash of the cells of each row, and whether it is up to date. Hashes
+	 * are only worked out when needed and are kept until the row changes.
+	 * (See 'linehash'.)
+	 */
+	ULONGLONG *hash;
+	bool *hashok;
+
+	/* The top and bottom rows of the scrolling region */
+	int top, bot;
 
 	/* Window-specific flags */
 	wflags_t flags;
 
+	/*
+	 * How long input functions wait for a key press, in milliseconds (or
+	 * forever if negative). (See 'wtimeout'.)
+	 */
+	int delay;
+
 	/* Window-specific attributes */
 	WORD attrs;
+
+	/*
+	 * The background character and attributes, which cleared cells are
+	 * filled with. (See 'wbkgd'.)
+	 */
+	chtype bkgd;
+
+	/*
+	 * The lock held by a thread while it draws in the window or refreshes it
+	 * (see 'wc_lock'), which subwindows share with the window whose cells
+	 * they share. (It is kept apart from the window, since windows are
+	 * copied when they are resized.)
+	 */
+	CRITICAL_SECTION *lock;
 } WINDOW;
 
+/*
+ * THREADS
+ *
+ * Windows which do not share cells may be drawn in by different threads at
+ * the same time, so long as each window is drawn in by one thread at a time.
+ * A thread drawing in a window which another thread refreshes holds the
+ * window's lock ('wc_lock') until it has finished a frame, since
+ * 'wnoutrefresh' and 'pnoutrefresh' take the same lock while they copy it.
+ *
+ * Updates to the screen are serialized by 'scrlock', which 'wnoutrefresh',
+ * 'pnoutrefresh', 'doupdate' and 'resizeterm' hold, so any thread may refresh
+ * its windows. Locks are always taken window first, then 'scrlock'.
+ *
+ * Everything else -- 'initscr' and 'endwin', making and deleting windows,
+ * input, colors and the wc_* settings -- belongs to the thread which called
+ * 'initscr'. (A render thread, see 'wc_render', only uses 'curscr' and the
+ * output backend, which anything else waits for it to finish with.)
+ *
+ * The library's state is kept in wincurses.c. Only the globals declared
+ * below are shared with programs; everything else (including 'scrlock') is
+ * private to the library.
+ */
+
+/* Ways of moving the cursor with virtual terminal sequences */
+typedef enum _vtmoves {
+	WC_MVABS = 0,    /* Absolute position */
+	WC_MVREL,        /* Relative rows, then a column movement */
+	WC_MVCRLF,       /* Carriage return and line feed, then a column movement */
+	/* Column movements */
+	WC_MVNONE,       /* Already in the right column */
+	WC_MVCR,         /* Carriage return */
+	WC_MVCOL,        /* Absolute column */
+	WC_MVFWD,        /* Forward */
+	WC_MVBACK,       /* Backward */
+	WC_MVCRFWD,      /* Carriage return, then forward */
+	WC_MVREWRITE     /* Rewrite the cells in between */
+} _vtmoves_t;
+
+/* Output backends */
+typedef enum backend {
+	WC_CONSOLE = 0, /* Win32 console API (the default) */
+	WC_VT,          /* Virtual terminal sequences */
+	WC_MEMORY       /* A screen in memory, with scripted input (no console) */
+} backend_t;
+
+/*
+ * Output backend type. Each backend provides functions to set up and restore
+ * the console, scroll rows of it, write spans of a window's cells to it (and
+ * move the cursor), follow changes in its size, set the cursor's visibility,
+ * read input records, and find out how big the console's window is.
+ */
+typedef struct output {
+	int (*init)(void);
+	int (*scroll)(int top, int bot, int n);
+	int (*flush)(WINDOW *win, SMALL_RECT *spans, int n);
+	int (*resize)(int lines, int cols);
+	int (*curs)(int visibility);
+	int (*read)(INPUT_RECORD *recs, DWORD len, DWORD *n, bool wait);
+	int (*size)(int *lines, int *cols);
+	int (*end)(void);
+} output_t;
+
 
 /*
  * Stdscr is the 'standard screen' (similar to stdin, stdout, and stderr). It is
  * essentially the window representing the console.
  */
-WINDOW *stdscr;
-
-/* Handle for restoring standard output later on */
-HANDLE hstdout;
+extern WINDOW *stdscr;
 
-/* Handle to input buffer */
-HANDLE hstdin;
+/*
+ * Newscr is the virtual screen which 'wnoutrefresh' copies windows onto, so
+ * that 'doupdate' can put them all on the console at once.
+ */
+extern WINDOW *newscr;
 
-/* Standard console cursor size */
-DWORD cursize;
+/*
+ * Curscr holds what is currently on the console. Updating compares 'newscr'
+ * against it so that only cells which actually differ are written out.
+ */
+extern WINDOW *curscr;
 
-/* Program flags */
-flags_t flags;
+/*
+ * The key codes key presses are translated to, for each virtual key code and
+ * combination of modifier keys held (see '_keymods_t' and wincurses.c for the
+ * defaults). Programs may change entries to rebind keys, which takes effect
+ * for key presses read afterwards.
+ */
+extern int keymap[256][WC_MODS];
 
 /* The number of lines and columns the terminal supports */
-int LINES;
-int COLS;
+extern int LINES;
+extern int COLS;
 
 /* The number of colors a terminal supports */
-int COLORS;
+extern int COLORS;
 
 /* The number of color pairs available for use */
-int COLOR_PAIRS;
-
-/* Color pair data */
-colorinfo_t color_pairs[MAX_NUM_PAIRS];
-
+extern int COLOR_PAIRS;
 
 /* Wincurses-specific declarations */
 
 WINDOW *initscr(void);
 int refresh(void);
+int wrefresh(WINDOW *win);
+int wnoutrefresh(WINDOW *win);
+int doupdate(void);
 int endwin(void);
 
+WINDOW *newwin(int nlines, int ncols, int begin_y, int begin_x);
+WINDOW *subwin(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x);
+WINDOW *derwin(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x);
+int delwin(WINDOW *win);
+int wresize(WINDOW *win, int lines, int columns);
+int resizeterm(int lines, int columns);
+
+WINDOW *newpad(int nlines, int ncols);
+WINDOW *subpad(WINDOW *orig, int nlines, int ncols, int begin_y, int begin_x);
+int prefresh(WINDOW *pad, int pminrow, int pmincol, int sminrow, int smincol,
+		int smaxrow, int smaxcol);
+int pnoutrefresh(WINDOW *pad, int pminrow, int pmincol, int sminrow,
+		int smincol, int smaxrow, int smaxcol);
+
+int wc_backend(int b);
+int wc_singlebuf(bool bf);
+int wc_spangap(int n);
+int wc_framerate(int ms);
+int wc_flush(void);
+int wc_render(bool bf);
+int wc_lock(WINDOW *win);
+int wc_unlock(WINDOW *win);
+int wc_stats(wcstats_t *s);
+int wc_memframe(CHAR_INFO *cells, COORD *cur);
+int wc_meminput(const INPUT_RECORD *recs, int n);
+
 int addch(const chtype ch);
 int mvaddch(int y, int x, const chtype ch);
 int mvwaddch(WINDOW *win, int y, int x, const chtype ch);
 int waddch(WINDOW *win, const chtype ch);
 
+int addstr(const char *str);
+int addnstr(const char *str, int n);
+int mvaddstr(int y, int x, const char *str);
+int mvaddnstr(int y, int x, const char *str, int n);
+int mvwaddstr(WINDOW *win, int y, int x, const char *str);
+int mvwaddnstr(WINDOW *win, int y, int x, const char *str, int n);
+int waddstr(WINDOW *win, const char *str);
+int waddnstr(WINDOW *win, const char *str, int n);
+
+int addchstr(const chtype *chstr);
+int addchnstr(const chtype *chstr, int n);
+int mvaddchstr(int y, int x, const chtype *chstr);
+int mvaddchnstr(int y, int x, const chtype *chstr, int n);
+int mvwaddchstr(WINDOW *win, int y, int x, const chtype *chstr);
+int mvwaddchnstr(WINDOW *win, int y, int x, const chtype *chstr, int n);
+int waddchstr(WINDOW *win, const chtype *chstr);
+int waddchnstr(WINDOW *win, const chtype *chstr, int n);
+
+int setcchar(cchar_t *wcval, const wchar_t *wch, const attr_t attrs,
+		short color_pair, const void *opts);
+int add_wch(const cchar_t *wch);
+int mvadd_wch(int y, int x, const cchar_t *wch);
+int mvwadd_wch(WINDOW *win, int y, int x, const cchar_t *wch);
+int wadd_wch(WINDOW *win, const cchar_t *wch);
+
+int addwstr(const wchar_t *wstr);
+int addnwstr(const wchar_t *wstr, int n);
+int mvaddwstr(int y, int x, const wchar_t *wstr);
+int mvaddnwstr(int y, int x, const wchar_t *wstr, int n);
+int mvwaddwstr(WINDOW *win, int y, int x, const wchar_t *wstr);
+int mvwaddnwstr(WINDOW *win, int y, int x, const wchar_t *wstr, int n);
+int waddwstr(WINDOW *win, const wchar_t *wstr);
+int waddnwstr(WINDOW *win, const wchar_t *wstr, int n);
+
+int erase(void);
+int werase(WINDOW *win);
+int clear(void);
+int wclear(WINDOW *win);
+int clearok(WINDOW *win, bool bf);
+int clrtoeol(void);
+int wclrtoeol(WINDOW *win);
+int clrtobot(void);
+int wclrtobot(WINDOW *win);
+
+int bkgd(chtype ch);
+int wbkgd(WINDOW *win, chtype ch);
+void bkgdset(chtype ch);
+void wbkgdset(WINDOW *win, chtype ch);
+chtype getbkgd(WINDOW *win);
+
+int copywin(const WINDOW *srcwin, WINDOW *dstwin, int sminrow, int smincol,
+		int dminrow, int dmincol, int dmaxrow, int dmaxcol, int overlay);
+int overlay(const WINDOW *srcwin, WINDOW *dstwin);
+int overwrite(const WINDOW *srcwin, WINDOW *dstwin);
+
 int printw(char *fmt, ...);
 int mvprintw(int y, int x, char *fmt, ...);
 int mvwprintw(WINDOW *win, int y, int x, char *fmt, ...);
@@ -366,6 +809,7 @@ int noecho(void);
 int keypad(WINDOW *win, bool bf);
 int cbreak(void);
 int nocbreak(void);
+int halfdelay(int tenths);
 int raw(void);
 int noraw(void);
 
@@ -373,6 +817,20 @@ int move(int y, int x);
 int wmove(WINDOW *win, int y, int x);
 
 int nodelay(WINDOW *win, bool bf);
+void timeout(int delay);
+void wtimeout(WINDOW *win, int delay);
+HANDLE wc_inputhandle(void);
+int wc_poll(wcevent_t *events, int max, int timeout);
+int wc_addhandle(HANDLE h, void *data);
+int wc_delhandle(HANDLE h);
+int wc_mouse(bool bf);
+
+int scrollok(WINDOW *win, bool bf);
+int setscrreg(int top, int bot);
+int wsetscrreg(WINDOW *win, int top, int bot);
+int scroll(WINDOW *win);
+int scrl(int n);
+int wscrl(WINDOW *win, int n);
 
 bool can_change_color(void);
 int color_content(short color, short *red, short *green, short *blue);
@@ -387,13 +845,4 @@ int start_color(void);
 int curs_set(int visibility);
 
 
-/* Windows-specific helper function declarations */
-
-void cls(HANDLE hcon);
-int setmode(HANDLE hcon, DWORD bmask);
-int clearmode(HANDLE hcon, DWORD bmask);
-int va_wprintw(WINDOW *win, char *fmt, va_list *args);
-WORD getattrs(unsigned int attrs);
-
-
 #endif /* __WINCURSES__ */